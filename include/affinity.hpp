@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Where one worker runs: the CPUs it is pinned to and the NUMA node its memory should
+ * come from, or -1 when the host exposes no topology.
+ */
+struct Placement {
+    int node = -1;
+    std::vector<int> cpus;
+};
+
+// Rows and encoded bytes moved by the workers of one node, and the time they spent on it
+struct NodeStats {
+    std::atomic<std::uint64_t> rows{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> busyNanos{0};
+    std::atomic<std::uint32_t> workers{0};
+};
+
+std::vector<int> parseCpuList(const std::string &list);
+
+std::vector<Placement> planPlacement(const std::string &cpuList, const bool perNode,
+                                     const std::uint32_t workers);
+
+void applyPlacement(const Placement &placement);
+
+int nodeCount();
+
+void printNodeStats(const std::vector<NodeStats> &stats);
@@ -1,9 +1,26 @@
 #pragma once
 
+#include "convert_cache.hpp"
+#include "time_zone.hpp"
 #include "types.hpp"
 #include <functional>
+#include <memory>
+#include <stdexcept>
 #include <unordered_map>
 
+using Converter = std::function<std::vector<char>(const std::string &)>;
+
+/**
+ * A value makeBinaryRow could not encode, tagged with its column so tolerant loads can
+ * report it.
+ */
+struct ConversionError : std::runtime_error {
+    ConversionError(const std::string &col, const std::string &why)
+        : std::runtime_error(col + ": " + why), column(col), reason(why) {}
+    const std::string column;
+    const std::string reason;
+};
+
 std::vector<char> int16Converter(const std::string &s);
 
 std::vector<char> int32Converter(const std::string &s);
@@ -14,10 +31,14 @@ std::vector<char> float4Converter(const std::string &s);
 
 std::vector<char> float8Converter(const std::string &s);
 
+std::vector<char> numericConverter(const std::string &s);
+
 std::vector<char> boolConverter(std::string s);
 
 std::vector<char> textConverter(const std::string &s);
 
+std::vector<char> byteaConverter(const std::string &s);
+
 std::vector<char> dateConverter(const std::string &s);
 
 std::vector<char> timeConverter(const std::string &s);
@@ -26,20 +47,41 @@ std::vector<char> timestampConverter(const std::string &s);
 
 std::vector<char> timestamptzConverter(const std::string &s);
 
+Converter zonedTimestamptzConverter(const std::shared_ptr<const TimeZone> &zone);
+
+std::vector<char> fixedDateConverter(const std::string &s);
+
+// For DATETIME(digits) and, withZone, UTC TIMESTAMP(digits) values
+Converter fixedTimestampConverter(const unsigned digits, const bool withZone);
+
 std::vector<char> macaddrConverter(const std::string &s);
 
 std::vector<char> uuidConverter(const std::string &s);
 
 std::vector<char> jsonConverter(const std::string &s);
 
+std::vector<char> jsonbConverter(const std::string &s);
+
 std::vector<char> inetConverter(const std::string &s);
 
 std::vector<char> enumConverter(const std::string &s);
 
+// text[] and int8[] from a JSON array or a MariaDB SET's comma-separated members
+std::vector<char> textArrayConverter(const std::string &s);
+
+std::vector<char> int64ArrayConverter(const std::string &s);
+
+void appendBinaryRow(std::vector<char> &out, const std::vector<Field> &row,
+                     const std::map<std::string, PgType> &mapping,
+                     const std::unordered_map<PgType, Converter> &converters,
+                     std::vector<ConvertCache> *caches = nullptr,
+                     const std::vector<Converter> *overrides = nullptr);
+
 std::vector<char> makeBinaryRow(
     const std::vector<Field> &row, const std::map<std::string, PgType> &mapping,
-    const std::unordered_map<
-        PgType, std::function<std::vector<char>(const std::string &)>> &converters);
+    const std::unordered_map<PgType, Converter> &converters,
+    std::vector<ConvertCache> *caches = nullptr,
+    const std::vector<Converter> *overrides = nullptr);
 
 std::vector<char> makeBinaryHeader();
 
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "throttle.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * Line-oriented control socket for a running migration, e.g.
+ *     echo 'bytes 20M' | nc -U migrate.sock
+ * Each connection sends one command and gets the reply back:
+ *     stats              progress, current rates and limits
+ *     rows <n>           source rows/s limit, 0 for none
+ *     bytes <n>[k|M|G]   source bytes/s limit, 0 for none
+ *     workers <n>        tables migrated at once, up to --threads
+ *     help               this list
+ * The socket is created owner-only and removed again on shutdown.
+ */
+class ControlServer {
+  public:
+    ControlServer(const std::string &path, Throttle &throttle, WorkerGate &gate,
+                  const std::size_t maxWorkers, std::function<std::string()> progress);
+    ~ControlServer();
+    ControlServer(const ControlServer &) = delete;
+    ControlServer &operator=(const ControlServer &) = delete;
+
+  private:
+    const std::string path;
+    Throttle &throttle;
+    WorkerGate &gate;
+    const std::size_t maxWorkers;
+    const std::function<std::string()> progress;
+    int fd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    // Previous stats sample, for rates since the last query
+    std::chrono::steady_clock::time_point lastAt = std::chrono::steady_clock::now();
+    std::uint64_t lastRows = 0;
+    std::uint64_t lastBytes = 0;
+
+    void serve();
+    std::string handle(const std::string &line);
+    std::string stats();
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Direct-mapped memo of raw source value -> encoded wire bytes for one column.
+ * The hit rate is judged over every window of lookups, and the cache switches itself
+ * off in the first window where it is too low, so a high-cardinality column only pays
+ * for a few thousand lookups however far into the table it turns unique.
+ */
+class ConvertCache {
+  public:
+    explicit ConvertCache(const bool enabled);
+
+    const std::vector<char> *find(const std::string &key);
+    void store(const std::string &key, const std::vector<char> &value);
+    bool enabled() const;
+    std::uint64_t hits() const;
+    std::uint64_t misses() const;
+
+  private:
+    struct Slot {
+        std::string key;
+        std::vector<char> value;
+        bool used = false;
+    };
+
+    static constexpr std::size_t slots = 256;
+    static constexpr std::size_t maxKeySize = 64;
+    static constexpr std::uint64_t window = 4096;
+    static constexpr std::uint64_t minHitsPerWindow = window / 4;
+
+    std::vector<Slot> table;
+    bool on;
+    std::uint64_t nHits = 0;
+    std::uint64_t nMisses = 0;
+    std::uint64_t windowLookups = 0;
+    std::uint64_t windowHits = 0;
+
+    Slot &slotFor(const std::string &key);
+};
+
+bool isCacheable(const PgType t);
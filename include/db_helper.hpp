@@ -2,11 +2,15 @@
 
 #include "binary.hpp"
 #include "csv.hpp"
+#include "memory_budget.hpp"
+#include "tune.hpp"
 #include "types.hpp"
+#include "utf8.hpp"
 #include <functional>
 #include <libpq-fe.h>
 #include <mariadb/mysql.h>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -27,28 +31,70 @@ using MysqlPtr = std::unique_ptr<MYSQL, MysqlDeleter>;
 using MysqlResPtr = std::unique_ptr<MYSQL_RES, MysqlResDeleter>;
 using PgPtr = std::unique_ptr<PGconn, PgDeleter>;
 
+MysqlPtr connectMysql(const MysqlConfig &myConfig);
+
+PgPtr connectPG(const PgsqlConfig &pgConfig);
+
+/**
+ * One COPY connection and the rows batched for it. table overrides the COPY target for
+ * partition leaves; only the primary stream of each destination runs control statements.
+ * In tolerant mode rowEnds and rowKeys delimit the buffered rows so a rejected batch can
+ * be split and replayed.
+ */
+struct CopyStream {
+    PgPtr pg;
+    std::vector<char> sendBuf;
+    std::string table;
+    bool primary = true;
+    std::vector<std::size_t> rowEnds;
+    std::vector<std::string> rowKeys;
+};
+
 class DBHelper {
   public:
-    DBHelper(const TableConf *config, const bool useCSV, const MysqlConfig &mConfig,
-             const PgsqlConfig &pConfig);
+    DBHelper(const TableConf *config, const RunConfig &rConfig,
+             const MysqlConfig &mConfig, const PgsqlConfig &pConfig,
+             const std::optional<KeyRange> &keyRange = std::nullopt);
+    ~DBHelper();
+    DBHelper(const DBHelper &) = delete;
+    DBHelper &operator=(const DBHelper &) = delete;
 
     void migrateTable();
+    TableProfile profile();
+    std::uint64_t rowsWritten() const;
+    std::uint64_t bytesWritten() const;
 
   private:
     const std::string fromTable;
     const std::string toTable;
+    const std::string stagingTable;
+    // The three names quoted for use in SQL; the bare ones label output and watermarks
+    const std::string toIdent;
+    const std::string stagingIdent;
+    const std::string fromIdent;
     const std::map<std::string, PgType> &mapping;
+    const std::map<std::string, std::string> &sources;
+    const std::vector<std::string> &ddl;
+    const std::string where;
+    const std::string keyCol;
+    const std::string watermarkCol;
     const bool useCSV;
-    const std::unordered_map<PgType,
-                             std::function<std::vector<char>(const std::string &)>>
-        converters = {
+    const bool incremental;
+    const bool truncateFirst;
+    const std::size_t sampleRows;
+    static constexpr std::size_t noShard = static_cast<std::size_t>(-1);
+    std::size_t shardCol = noShard;
+    const std::vector<std::int64_t> &shardBounds;
+    const std::unordered_map<PgType, Converter> converters = {
             {PgType::INT16, int16Converter},
             {PgType::INT32, int32Converter},
             {PgType::INT64, int64Converter},
             {PgType::FLOAT4, float4Converter},
             {PgType::FLOAT8, float8Converter},
+            {PgType::NUMERIC, numericConverter},
             {PgType::BOOL, boolConverter},
             {PgType::TEXT, textConverter},
+            {PgType::BYTEA, byteaConverter},
             {PgType::DATE, dateConverter},
             {PgType::TIME, timeConverter},
             {PgType::TIMESTAMP, timestampConverter},
@@ -56,26 +102,127 @@ class DBHelper {
             {PgType::MACADDR, macaddrConverter},
             {PgType::UUID, uuidConverter},
             {PgType::JSON, jsonConverter},
+            {PgType::JSONB, jsonbConverter},
             {PgType::INET, inetConverter},
             {PgType::ENUM, enumConverter},
+            {PgType::TEXT_ARRAY, textArrayConverter},
+            {PgType::INT64_ARRAY, int64ArrayConverter},
     };
 
     MysqlPtr mysql;
-    PgPtr pg;
     MysqlResPtr res;
+    std::vector<CopyStream> streams;
 
     MysqlConfig myConfig;
-    PgsqlConfig pgConfig;
+    std::vector<PgsqlConfig> pgConfigs;
+
+    struct Partition {
+        std::int64_t low;
+        std::int64_t high;
+        std::size_t stream;
+    };
+    const std::size_t maxPartitionStreams;
+    std::vector<Partition> partitions;
+    std::size_t partitionCol = 0;
+    std::size_t defaultPartition = noShard;
+
+    bool textCopy = false;
+
+    std::string lowWater;
+    std::string highWater;
+
+    std::size_t sendBufferSize;
+    static constexpr std::size_t minSendBuffer = 8 << 10;
+    BudgetLease lease;
+
+    DeadLetter *deadLetter;
+    std::size_t keyIndex = noShard;
+    std::string copyTarget;
+    std::size_t rejected = 0;
+    std::uint64_t rowsOut = 0;
+    std::uint64_t bytesOut = 0;
+
+    /**
+     * One row is in flight per worker and is encoded straight into the send buffer's
+     * copy, so its fields and encoding reuse the same storage for every row.
+     */
+    std::vector<Field> rowBuf;
+    std::vector<char> encodeBuf;
+    std::size_t rowBufferPeak = 0;
+
+    std::vector<ConvertCache> caches;
+    std::vector<Converter> overrides;
+
+    // Source charset of each text-like column, empty when the table has none
+    std::vector<std::optional<Charset>> charsets;
+    const InvalidText invalidText;
+    std::string textScratch;
+
+    SnapshotPool *snapshotPool;
+
+    // Fetched rows and bytes not yet charged to the throttle, which is paid in chunks
+    Throttle *throttle;
+    std::size_t paceRows = 0;
+    std::size_t paceBytes = 0;
+
+    /**
+     * With several replicas a table on an integer key is read as key-range chunks, each
+     * by a helper of its own on whichever replica is least loaded; the table's helper
+     * keeps only the DDL, triggers and watermark. range is set on the chunk helpers.
+     */
+    const TableConf *tableConf;
+    const RunConfig runConfig;
+    ReplicaSet *replicas;
+    std::size_t replica = noShard;
+    const std::optional<KeyRange> range;
+    std::vector<KeyRange> chunks;
 
-    void startCopy();
+    std::string columnList() const;
+    std::string selectList() const;
+    std::string sourceKey() const;
+    void startCopy(const std::string &table);
+    void startCopy(PGconn *pg, const std::string &table);
     MYSQL_ROW getMysqlRow();
-    void writeData(const std::vector<Field> &result);
+    std::size_t reserveRow(const std::size_t rawBytes, const std::size_t ncols);
+    std::size_t route(const std::vector<Field> &result) const;
+    void writeData(std::vector<Field> &result, const std::size_t rowBytes);
+    void releaseRow(const std::size_t rowBytes);
+    void fillRow(const MYSQL_ROW &row, const unsigned long *lengths);
+    void normaliseText(std::vector<Field> &result);
+    const std::vector<char> &encodeRow(std::vector<Field> &result);
+    const std::string &keyOf(const std::vector<Field> &result) const;
+    void queueRow(CopyStream &stream, const std::vector<char> &data,
+                  const std::string &key);
+    void sendData(PGconn *pg, const char *data, const std::size_t size);
+    void flush(CopyStream &stream);
+    void loadBatch(CopyStream &stream, const char *data, const std::size_t *ends,
+                   const std::string *keys, const std::size_t first,
+                   const std::size_t last);
+    std::string tryCopy(CopyStream &stream, const char *data, const std::size_t size);
+    void pace(const std::size_t rawBytes);
     void writeMysqlRow(const MYSQL_ROW &row);
     void writeCSVRow(const csv::CSVRow &row);
     void endCopy();
+    void endCopy(PGconn *pg);
     void initPGConnection();
+    void discoverPartitions();
+    std::size_t partitionFor(const std::vector<char> &data) const;
     void initMysqlConnection();
     void createTable();
     void disableTriggers();
     void enableTriggers();
+    void execPG(const std::string &sql, const std::string &what);
+    void execPG(PGconn *pg, const std::string &sql, const std::string &what);
+    std::string queryHighWater();
+    std::uint64_t estimateRows();
+    void loadWatermark();
+    void saveWatermark();
+    void createStaging();
+    void mergeStaging();
+    void copyRows();
+    std::vector<KeyRange> splitKeys();
+    void copyChunks();
+    void readChunks();
+    void reportCaches() const;
+    std::size_t rowBufferBytes() const;
 };
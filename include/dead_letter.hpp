@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+/**
+ * Rows rejected in tolerant mode, shared by every worker. Each line is one row in COPY
+ * text format (table, key, column, reason), so the file loads straight back with
+ * \copy for triage; column is NULL when the server rejected the row as a whole.
+ */
+class DeadLetter {
+  public:
+    explicit DeadLetter(const std::string &path);
+
+    void reject(const std::string &table, const std::string &key,
+                const std::string &column, const std::string &reason);
+    std::size_t count();
+
+  private:
+    std::mutex m;
+    std::ofstream out;
+    std::size_t rows = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "db_helper.hpp"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Post-load upkeep for each table, queued the moment its load commits and run by a
+ * pool with its own connections so it overlaps the tables still copying. Every table
+ * on every destination gets its identity and serial sequences moved past MAX(column),
+ * then ANALYZE, or VACUUM (FREEZE, ANALYZE) when freeze is set.
+ */
+class Maintenance {
+  public:
+    Maintenance(const std::vector<PgsqlConfig> &destinations, const std::size_t workers,
+                const bool freeze);
+    ~Maintenance();
+    Maintenance(const Maintenance &) = delete;
+    Maintenance &operator=(const Maintenance &) = delete;
+
+    void enqueue(const std::string &table);
+    // Drains the queue and joins the pool, rethrowing the first failure
+    void finish();
+
+  private:
+    const std::vector<PgsqlConfig> destinations;
+    const bool freeze;
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::string> queue;
+    bool closed = false;
+    std::exception_ptr error;
+    std::vector<std::thread> pool;
+
+    void run();
+    void maintain(PGconn *pg, const std::string &table);
+};
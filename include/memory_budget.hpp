@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+/**
+ * Process-wide byte budget shared by every worker's row and send buffers.
+ * A request that would overshoot the limit blocks until other workers release, except
+ * when nothing is held at all, so a single oversized row can always make progress.
+ */
+class MemoryBudget {
+  public:
+    explicit MemoryBudget(const std::size_t limit);
+
+    bool tryAcquire(const std::size_t bytes);
+    void acquire(const std::size_t bytes);
+    void release(const std::size_t bytes);
+    std::size_t limit() const;
+    std::size_t peak();
+
+  private:
+    const std::size_t cap;
+    std::size_t used = 0;
+    std::size_t highWater = 0;
+    std::mutex m;
+    std::condition_variable cv;
+
+    bool fits(const std::size_t bytes) const;
+    void take(const std::size_t bytes);
+};
+
+/**
+ * RAII share of a MemoryBudget held by one worker. Everything still held is returned on
+ * destruction so a failed table cannot starve the others.
+ */
+class BudgetLease {
+  public:
+    explicit BudgetLease(MemoryBudget *budget);
+    ~BudgetLease();
+    BudgetLease(const BudgetLease &) = delete;
+    BudgetLease &operator=(const BudgetLease &) = delete;
+
+    bool tryGrow(const std::size_t bytes);
+    void grow(const std::size_t bytes);
+    void shrink(const std::size_t bytes);
+    std::size_t held() const;
+
+  private:
+    MemoryBudget *budget;
+    std::size_t bytesHeld = 0;
+};
+
+std::size_t peakRSSBytes();
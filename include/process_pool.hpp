@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+struct TaskResult {
+    std::uint64_t rows = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t rejected = 0;
+    double seconds = 0;
+};
+
+/**
+ * Worker side of process mode: run each task read from taskFd, one line
+ * "<task> <attempt> <name>" apiece, answering on resultFd with "done <task> <rows>
+ * <bytes> <rejected> <seconds>" or "fail <task> <reason>". The task is run by name,
+ * since a worker's own view of the task list may differ from the coordinator's.
+ * Returns once the coordinator closes taskFd.
+ */
+int serveTasks(
+    const int taskFd, const int resultFd,
+    const std::function<TaskResult(const std::string &, unsigned)> &run);
+
+/**
+ * Coordinator side of process mode. Each worker is this binary re-executed with the
+ * same arguments plus --worker-fds, so it shares no memory, allocator or client-library
+ * state with the others, and talks to the coordinator over a pipe each way. A task that
+ * fails, or whose worker dies, is queued again up to retries times; a dead worker is
+ * replaced while tasks remain.
+ */
+class ProcessPool {
+  public:
+    ProcessPool(std::vector<std::string> command, const std::size_t processes,
+                const unsigned retries);
+    ~ProcessPool();
+    ProcessPool(const ProcessPool &) = delete;
+    ProcessPool &operator=(const ProcessPool &) = delete;
+
+    // Runs the named tasks, returning the indexes of those that used up their retries
+    std::vector<std::size_t>
+    run(const std::vector<std::string> &names,
+        const std::function<void(std::size_t, const TaskResult &)> &done);
+
+  private:
+    struct Worker {
+        pid_t pid = -1;
+        int taskFd = -1;
+        int resultFd = -1;
+        std::string pending;
+        std::optional<std::size_t> task;
+    };
+
+    const std::vector<std::string> command;
+    const std::size_t processes;
+    const unsigned retries;
+    std::vector<Worker> workers;
+
+    void spawn(Worker &w);
+    std::string reap(Worker &w);
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "db_helper.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Equivalent read replicas of the source. Every read takes the replica with the fewest
+ * reads open, breaking ties by the fewest served so far, so whole tables and key-range
+ * chunks of one table alike spread by load. A read holds its replica until released.
+ */
+class ReplicaSet {
+  public:
+    explicit ReplicaSet(std::vector<MysqlConfig> replicas);
+
+    /**
+     * Blocks until every replica has applied gtid, throwing for the first one still
+     * behind once timeoutSecs have passed in total.
+     */
+    void waitFor(const std::string &gtid, const double timeoutSecs) const;
+
+    std::size_t acquire();
+    void release(const std::size_t replica);
+    const MysqlConfig &config(const std::size_t replica) const;
+    std::size_t size() const;
+
+  private:
+    const std::vector<MysqlConfig> configs;
+    std::mutex m;
+    std::vector<std::size_t> open;
+    std::vector<std::uint64_t> served;
+};
+
+// Binlog GTID position of the primary: what the replicas must reach before reading
+std::string primaryPosition(const MysqlConfig &primary);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "db_helper.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * A source table as MariaDB's information_schema describes it: the TableConf that
+ * migrates it, whose ddl creates it with its primary key, and the unique and foreign
+ * key constraints kept back until every table is loaded.
+ */
+struct TableSchema {
+    TableConf conf;
+    std::vector<std::string> constraints;
+};
+
+/**
+ * Reads COLUMNS, TABLE_CONSTRAINTS, KEY_COLUMN_USAGE and CHECK_CONSTRAINTS for the
+ * connection's database. only restricts it to the named tables; naming one that does
+ * not exist throws. Each column gets the narrowest PgType its declared type allows, and
+ * temporal columns the fixed-width converters. tinyint(1) is smallint, as it can hold
+ * any tinyint, unless tinyintBool takes it as boolean, which then fails on values
+ * other than 0 and 1.
+ */
+std::vector<TableSchema> introspect(MYSQL *mysql, const std::vector<std::string> &only,
+                                    const bool tinyintBool = false);
+
+/**
+ * Adds the deferred constraints on one destination. Foreign keys are created DEFERRABLE
+ * INITIALLY DEFERRED and every statement skips constraints that already exist, so
+ * re-runs and incremental loads can apply them again.
+ */
+void addConstraints(PGconn *pg, const std::vector<TableSchema> &schemas);
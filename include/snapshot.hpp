@@ -0,0 +1,28 @@
+#pragma once
+
+#include "db_helper.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Reader connections that all see the source at the same point in time.
+ * The coordinator holds FLUSH TABLES WITH READ LOCK only while every pooled connection
+ * runs START TRANSACTION WITH CONSISTENT SNAPSHOT, so no commit can land between them.
+ * Workers borrow a connection per table and hand it back once its result is drained.
+ */
+class SnapshotPool {
+  public:
+    SnapshotPool(const MysqlConfig &myConfig, const std::size_t size);
+
+    MysqlPtr take();
+    void give(MysqlPtr conn);
+    const std::string &position() const;
+
+  private:
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<MysqlPtr> idle;
+    std::string gtid;
+};
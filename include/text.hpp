@@ -0,0 +1,19 @@
+#pragma once
+
+#include "types.hpp"
+#include <string>
+#include <vector>
+
+void appendTextField(std::vector<char> &out, const std::string &value);
+
+void appendTextRow(std::vector<char> &out, const std::vector<Field> &row);
+
+std::vector<char> makeTextRow(const std::vector<Field> &row);
+
+// name as a PostgreSQL identifier, so reserved words and mixed case survive
+std::string quoteIdent(const std::string &name);
+
+// name as a MariaDB identifier
+std::string quoteSourceIdent(const std::string &name);
+
+CopyFormat chooseCopyFormat(const std::map<std::string, PgType> &mapping);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * Process-wide token buckets for source rows/s and bytes/s, charged by every worker as
+ * it fetches. A charge that overdraws a bucket sleeps until the debt is refilled, so
+ * the aggregate rate holds however the workers interleave; each bucket holds at most a
+ * second's worth, which bounds the burst after an idle spell. Limits can change while
+ * workers are waiting, and when both are off a charge only bumps the counters.
+ * Workers sleep mid-result, so chargeRows/chargeBytes size each charge to a tenth of a
+ * second at the current limits, capped at 64 rows and 64 KiB, keeping every sleep far
+ * under the server's net_write_timeout. A single row larger than the byte limit times
+ * that timeout still overruns it, which bounds how low the byte limit can safely go.
+ */
+class Throttle {
+  public:
+    // 0 leaves that dimension unlimited
+    void setLimits(const double rowsPerSec, const double bytesPerSec);
+    double rowLimit();
+    double byteLimit();
+
+    void take(const std::size_t rows, const std::size_t bytes);
+    std::size_t chargeRows() const;
+    std::size_t chargeBytes() const;
+    std::uint64_t rows() const;
+    std::uint64_t bytes() const;
+
+  private:
+    std::mutex m;
+    std::condition_variable cv;
+    std::atomic<bool> limited{false};
+    double rowRate = 0;
+    double byteRate = 0;
+    double rowTokens = 0;
+    double byteTokens = 0;
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+    std::atomic<std::uint64_t> rowCount{0};
+    std::atomic<std::uint64_t> byteCount{0};
+    static constexpr std::size_t maxChargeRows = 64;
+    static constexpr std::size_t maxChargeBytes = 64 << 10;
+    std::atomic<std::size_t> rowCharge{maxChargeRows};
+    std::atomic<std::size_t> byteCharge{maxChargeBytes};
+
+    void refill();
+};
+
+/**
+ * Caps how many workers migrate a table at once, adjustable at run time. Lowering it
+ * takes effect as workers finish their current table, since pausing mid-table would
+ * leave the MariaDB result unread past the server's net_write_timeout.
+ */
+class WorkerGate {
+  public:
+    explicit WorkerGate(const std::size_t limit);
+
+    // Blocks while the gate is full; false once shut down
+    bool enter();
+    void leave();
+    void setLimit(const std::size_t limit);
+    void shutdown();
+    std::size_t active();
+    std::size_t limit();
+
+  private:
+    std::mutex m;
+    std::condition_variable cv;
+    std::size_t cap;
+    std::size_t inside = 0;
+    bool closed = false;
+};
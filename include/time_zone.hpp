@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * A zone from /usr/share/zoneinfo flattened into sorted local-time intervals, each with
+ * its UTC offset. Explicit TZif transitions are extended with the footer's POSIX rule
+ * up to 2100, so local -> UTC is a bounds check against a cached interval and, on a
+ * miss, a binary search. No libc time zone state is touched after loading.
+ */
+class TimeZone {
+  public:
+    // Parsed once per name and shared by every worker
+    static std::shared_ptr<const TimeZone> load(const std::string &name);
+
+    explicit TimeZone(const std::string &name);
+
+    /**
+     * hint is the caller's cached interval index, updated on a miss.
+     * Non-existent local times (spring forward) use the offset before the gap and
+     * ambiguous ones (fall back) the offset after the transition.
+     */
+    std::int64_t toUTC(const std::int64_t local, std::size_t &hint) const;
+
+  private:
+    std::vector<std::int64_t> utcStarts;
+    std::vector<std::int64_t> localStarts;
+    std::vector<std::int32_t> offsets;
+
+    void parseTZif(const std::string &data, const std::string &name);
+    void extendWithRule(const std::string &rule);
+};
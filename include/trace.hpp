@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Timeline spans around the blocking steps of a migration, compiled in only when built
+ * with -DTRACE=ON. Each thread records into its own ring, so recording never takes a
+ * lock; once a ring wraps its oldest spans are overwritten. Spans shorter than 10 us
+ * are dropped, so per-row spans only leave the stalls behind. writeTrace dumps every
+ * ring as Chrome trace-event JSON for Perfetto or chrome://tracing, after the workers
+ * have joined.
+ */
+#ifdef MIGRATE_TRACE
+
+inline std::uint64_t traceNow() {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+void traceRecord(const char *name, const std::uint64_t start, const std::uint64_t end);
+
+void writeTrace(const std::string &path);
+
+class TraceSpan {
+  public:
+    explicit TraceSpan(const char *spanName) : name(spanName), start(traceNow()) {}
+    ~TraceSpan() { traceRecord(name, start, traceNow()); }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+  private:
+    const char *name;
+    const std::uint64_t start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) const TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#else
+
+#define TRACE_SPAN(name) ((void)0)
+
+#endif
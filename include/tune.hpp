@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * What a dry run measured for one table: the source's row estimate and, for the sampled
+ * rows, the time spent fetching, encoding and COPYing them, each on its own.
+ */
+struct TableProfile {
+    std::string table;
+    std::uint64_t rows = 0;
+    std::size_t sampled = 0;
+    std::size_t bytes = 0;
+    double fetchSecs = 0;
+    double encodeSecs = 0;
+    double copySecs = 0;
+};
+
+struct TunePlan {
+    std::uint32_t threads = 1;
+    std::size_t sendBufferSize = 1 << 20;
+    double predictedSecs = 0;
+    std::vector<std::size_t> tableBuffers;
+    std::vector<double> tableSecs;
+};
+
+TunePlan planRun(const std::vector<TableProfile> &profiles,
+                 const std::uint32_t maxThreads);
+
+void printPlan(const std::vector<TableProfile> &profiles, const TunePlan &plan);
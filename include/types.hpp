@@ -1,7 +1,17 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <map>
+#include <optional>
 #include <string>
+#include <vector>
+
+class DeadLetter;
+class MemoryBudget;
+class ReplicaSet;
+class SnapshotPool;
+class Throttle;
 
 struct MysqlConfig {
     std::string myname;
@@ -25,8 +35,10 @@ enum class PgType {
     INT64,
     FLOAT4,
     FLOAT8,
+    NUMERIC,
     BOOL,
     TEXT,
+    BYTEA,
     DATE,
     TIME,
     TIMESTAMP,
@@ -34,16 +46,87 @@ enum class PgType {
     MACADDR,
     UUID,
     JSON,
+    JSONB,
     INET,
-    ENUM
+    ENUM,
+    TEXT_ARRAY,
+    INT64_ARRAY
 };
 
+enum class CopyFormat { BINARY, TEXT, AUTO };
+
+// What to do with text that is not valid UTF-8 once decoded from its source charset
+enum class InvalidText { REJECT, REPLACE, STRIP };
+
+/**
+ * keyCol is the conflict target used when merging incremental deltas.
+ * watermarkCol is the change-tracking column; leave empty to opt the table out of
+ * incremental mode.
+ * sourceZone names the zoneinfo zone that offset-less TIMESTAMPTZ source values are in
+ * (empty falls back to --source-tz, then UTC); columnZones overrides it per column.
+ * The rest is pushed down into the MariaDB SELECT: sourceTable when the source is
+ * named differently, where as a row filter, and sources mapping a destination column
+ * to the source column or SQL expression that produces it.
+ * With several destination shards, shardKey routes each row by hash, or by range when
+ * shardBounds lists the N-1 ascending upper bounds; tables without one are copied to
+ * every shard.
+ * format overrides the run's COPY format for this table.
+ * charset declares what encoding the source text bytes are really in (empty falls back
+ * to --source-charset, then utf8); columnCharsets overrides it per column. Once any
+ * column declares a non-UTF-8 charset the table is read as stored, untranscoded, so
+ * every text column's declaration must then match its stored charset.
+ * fixedTemporal lists DATE, TIMESTAMP and TIMESTAMPTZ columns whose source renders them
+ * at a fixed width, with their fraction digits, so they get fixed-offset parsers.
+ * ddl holds the statements that create the destination table, run before loading it.
+ */
 struct TableConf {
     const std::string tabName;
     const std::map<std::string, PgType> map;
+    const std::string keyCol = "id";
+    const std::string watermarkCol = "updated_at";
+    const std::string sourceZone = "";
+    const std::map<std::string, std::string> columnZones = {};
+    const std::string sourceTable = "";
+    const std::string where = "";
+    const std::map<std::string, std::string> sources = {};
+    const std::string shardKey = "";
+    const std::vector<std::int64_t> shardBounds = {};
+    const std::optional<CopyFormat> format = std::nullopt;
+    const std::string charset = "";
+    const std::map<std::string, std::string> columnCharsets = {};
+    const std::map<std::string, unsigned> fixedTemporal = {};
+    const std::vector<std::string> ddl = {};
+};
+
+struct RunConfig {
+    bool useCSV = false;
+    bool incremental = false;
+    bool convertCache = false;
+    std::string sourceZone;
+    SnapshotPool *snapshotPool = nullptr;
+    std::vector<PgsqlConfig> shards;
+    std::size_t maxPartitionStreams = 16;
+    CopyFormat format = CopyFormat::BINARY;
+    DeadLetter *deadLetter = nullptr;
+    std::string sourceCharset;
+    InvalidText invalidText = InvalidText::REJECT;
+    std::size_t sampleRows = 0;
+    MemoryBudget *budget = nullptr;
+    std::size_t sendBufferSize = 1 << 20;
+    std::size_t sendBudget = 0; // A worker's send buffers over all streams, 0 for any
+    Throttle *throttle = nullptr;
+    ReplicaSet *replicas = nullptr;
+    bool truncateFirst = false; // Empty the whole table first: a retry may be part-loaded
+};
+
+// Inclusive span of integer key values, read by one reader of a fanned-in table
+struct KeyRange {
+    std::int64_t low;
+    std::int64_t high;
+    bool nulls = false; // Also rows without a key, so exactly one chunk reads them
 };
 
 struct Field {
-    const std::string column;
-    const std::string value;
+    std::string column;
+    std::string value;
 };
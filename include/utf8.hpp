@@ -0,0 +1,33 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstddef>
+#include <string>
+
+/**
+ * Byte encodings a source text column can be declared in. CP1252 is what MariaDB calls
+ * latin1: Windows-1252, with its five unassigned bytes passed through as the matching
+ * C1 controls, as the server does. LATIN1 is strict ISO-8859-1, every byte its own code
+ * point.
+ */
+enum class Charset { UTF8, LATIN1, CP1252 };
+
+// utf8, utf8mb3 and utf8mb4; latin1 and cp1252; iso-8859-1. Case-insensitive.
+Charset parseCharset(const std::string &name);
+
+/**
+ * True when data is well-formed UTF-8 that PostgreSQL will accept as text: no overlong
+ * forms, surrogates or code points past U+10FFFF, and no NUL bytes. Checks 16 bytes per
+ * step with SSSE3 (x86-64-v2 release builds), otherwise skips ASCII 16 bytes at a time.
+ */
+bool isValidUtf8(const char *data, const std::size_t size);
+
+/**
+ * Leaves value as valid UTF-8, transcoding it from a single-byte charset first.
+ * Under REJECT an invalid sequence or NUL throws std::invalid_argument naming its byte
+ * offset; REPLACE writes one U+FFFD per offending byte and STRIP drops it. Clean values
+ * are left untouched; otherwise the result is built in scratch and swapped in, so both
+ * buffers keep their capacity across rows.
+ */
+void toUtf8(std::string &value, const Charset from, const InvalidText policy,
+            std::string &scratch);
@@ -0,0 +1,163 @@
+#include "affinity.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static constexpr int mpolPreferred = 1; // MPOL_PREFERRED, without pulling in libnuma
+
+// Kernel CPU list syntax, as in /sys and taskset: "0-7,16-23"
+std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        try {
+            const std::size_t dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last =
+                dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int c = first; c <= last; c++) {
+                cpus.push_back(c);
+            }
+        } catch (const std::logic_error &) {
+            throw std::runtime_error("Invalid CPU list: " + list);
+        }
+    }
+    return cpus;
+}
+
+// Node of every online CPU from sysfs; hosts without it count as one node 0
+static std::map<int, int> cpuNodes() {
+    std::map<int, int> nodes;
+    const std::filesystem::path root = "/sys/devices/system/node";
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(root, ec)) {
+        const std::string name = entry.path().filename();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 ||
+            name.find_first_not_of("0123456789", 4) != std::string::npos) {
+            continue;
+        }
+        std::ifstream in(entry.path() / "cpulist");
+        std::string list;
+        std::getline(in, list);
+        for (const int cpu : parseCpuList(list)) {
+            nodes[cpu] = std::stoi(name.substr(4));
+        }
+    }
+    if (nodes.empty()) {
+        const long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int cpu = 0; cpu < online; cpu++) {
+            nodes[cpu] = 0;
+        }
+    }
+    return nodes;
+}
+
+int nodeCount() {
+    int most = 0;
+    for (const auto &[cpu, node] : cpuNodes()) {
+        most = std::max(most, node + 1);
+    }
+    return most;
+}
+
+/**
+ * perNode spreads workers round-robin over the nodes holding the allowed CPUs and lets
+ * each float across its node's CPUs; otherwise each worker is pinned to one allowed CPU
+ * in turn. An empty cpuList allows every online CPU.
+ */
+std::vector<Placement> planPlacement(const std::string &cpuList, const bool perNode,
+                                     const std::uint32_t workers) {
+    const std::map<int, int> nodes = cpuNodes();
+    std::vector<int> allowed;
+    if (cpuList.empty()) {
+        for (const auto &[cpu, node] : nodes) {
+            allowed.push_back(cpu);
+        }
+    } else {
+        allowed = parseCpuList(cpuList);
+    }
+    for (const int cpu : allowed) {
+        if (nodes.find(cpu) == nodes.end()) {
+            throw std::runtime_error("CPU " + std::to_string(cpu) + " is not online");
+        }
+    }
+    if (allowed.empty()) {
+        throw std::runtime_error("No CPUs to place workers on");
+    }
+    std::vector<Placement> groups;
+    if (perNode) {
+        std::map<int, Placement> byNode;
+        for (const int cpu : allowed) {
+            Placement &p = byNode[nodes.at(cpu)];
+            p.node = nodes.at(cpu);
+            p.cpus.push_back(cpu);
+        }
+        for (auto &[node, p] : byNode) {
+            groups.push_back(std::move(p));
+        }
+    } else {
+        for (const int cpu : allowed) {
+            groups.push_back({nodes.at(cpu), {cpu}});
+        }
+    }
+    std::vector<Placement> placements;
+    for (std::uint32_t i = 0; i < workers; i++) {
+        placements.push_back(groups[i % groups.size()]);
+    }
+    return placements;
+}
+
+/**
+ * Pin the calling thread and make its node the preferred source of new pages. Row and
+ * send buffers are allocated and first written by the worker itself, so with the thread
+ * already on its node they are faulted in locally.
+ */
+void applyPlacement(const Placement &placement) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : placement.cpus) {
+        CPU_SET(cpu, &set);
+    }
+    const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        throw std::runtime_error("Cannot pin worker: " + std::string(strerror(err)));
+    }
+    if (placement.node < 0 || placement.node >= 64) {
+        return;
+    }
+    const unsigned long mask = 1UL << placement.node;
+    // Best effort: kernels without NUMA support reject the call and first touch remains
+    syscall(SYS_set_mempolicy, mpolPreferred, &mask,
+            static_cast<unsigned long>(placement.node + 2));
+}
+
+void printNodeStats(const std::vector<NodeStats> &stats) {
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1);
+    for (std::size_t node = 0; node < stats.size(); node++) {
+        const NodeStats &s = stats[node];
+        if (s.workers == 0) {
+            continue;
+        }
+        const double secs = static_cast<double>(s.busyNanos) / 1e9;
+        const double mib = static_cast<double>(s.bytes) / (1 << 20);
+        report << "Node " << node << ": " << s.workers << " workers, " << s.rows
+               << " rows, " << mib << " MiB, "
+               << (secs > 0 ? mib / secs : 0) << " MiB/s per busy worker\n";
+    }
+    std::cout << report.str() << std::flush;
+}
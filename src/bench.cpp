@@ -0,0 +1,125 @@
+#include "binary.hpp"
+#include "text.hpp"
+#include "types.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Times the binary and text COPY encoders on synthetic rows shaped like the users,
+ * sites and jobs tables. No database is needed; pass the row count as the only argument.
+ */
+
+std::mt19937 rng(42);
+
+std::string randomString(int length) {
+    const char charset[] = "abcdefghijklmnopqrstuvwxyz";
+    std::uniform_int_distribution<> dist(0, 25);
+    std::string result;
+    for (int i = 0; i < length; ++i) {
+        result += charset[dist(rng)];
+    }
+    return result;
+}
+
+std::string randomTimestamp() {
+    std::uniform_int_distribution<> day(1, 28);
+    std::uniform_int_distribution<> sec(0, 59);
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "2024-03-%02d 12:%02d:%02d", day(rng), sec(rng),
+                  sec(rng));
+    return buf;
+}
+
+using Rows = std::vector<std::vector<Field>>;
+using Encoder = std::function<std::vector<char>(const std::vector<Field> &)>;
+
+Rows makeRows(const TableConf &conf, const std::size_t count) {
+    std::uniform_int_distribution<long long> id(1, 1000000);
+    Rows rows;
+    rows.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        std::vector<Field> row;
+        for (const auto &[col, type] : conf.map) {
+            switch (type) {
+            case PgType::INT64:
+                row.push_back({col, std::to_string(id(rng))});
+                break;
+            case PgType::DATE:
+                row.push_back({col, randomTimestamp().substr(0, 10)});
+                break;
+            case PgType::TIMESTAMPTZ:
+                row.push_back({col, randomTimestamp()});
+                break;
+            default:
+                row.push_back({col, randomString(24)});
+            }
+        }
+        rows.push_back(std::move(row));
+    }
+    return rows;
+}
+
+void timeEncoder(const std::string &label, const Rows &rows,
+                 const Encoder &encode) {
+    std::size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto &row : rows) {
+        bytes += encode(row).size();
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "  " << label << ": " << elapsed.count() * 1000 << " ms, "
+              << static_cast<double>(bytes) / static_cast<double>(rows.size())
+              << " bytes/row, " << static_cast<double>(rows.size()) / elapsed.count()
+              << " rows/s" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    const std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    const std::unordered_map<PgType, Converter> converters = {
+        {PgType::INT64, int64Converter},
+        {PgType::TEXT, textConverter},
+        {PgType::DATE, dateConverter},
+        {PgType::TIMESTAMPTZ, timestamptzConverter},
+    };
+    const std::vector<TableConf> tables = {
+        {"users",
+         {{"id", PgType::INT64},
+          {"username", PgType::TEXT},
+          {"email", PgType::TEXT},
+          {"password", PgType::TEXT},
+          {"created_at", PgType::TIMESTAMPTZ},
+          {"updated_at", PgType::TIMESTAMPTZ}}},
+        {"sites",
+         {{"id", PgType::INT64},
+          {"name", PgType::TEXT},
+          {"user_id", PgType::INT64},
+          {"created_at", PgType::TIMESTAMPTZ},
+          {"updated_at", PgType::TIMESTAMPTZ}}},
+        {"jobs",
+         {{"id", PgType::INT64},
+          {"start_date", PgType::DATE},
+          {"site_id", PgType::INT64},
+          {"created_at", PgType::TIMESTAMPTZ},
+          {"updated_at", PgType::TIMESTAMPTZ}}},
+    };
+
+    for (const auto &conf : tables) {
+        const Rows rows = makeRows(conf, count);
+        const bool autoText = chooseCopyFormat(conf.map) == CopyFormat::TEXT;
+        std::cout << conf.tabName << " (auto picks " << (autoText ? "text" : "binary")
+                  << ")" << std::endl;
+        timeEncoder("binary", rows, [&](const std::vector<Field> &row) {
+            return makeBinaryRow(row, conf.map, converters);
+        });
+        timeEncoder("text  ", rows, makeTextRow);
+    }
+    return 0;
+}
@@ -1,10 +1,15 @@
 #include "binary.hpp"
 #include <algorithm>
 #include <arpa/inet.h>
+#include <array>
+#include <charconv>
 #include <cstring>
 #include <ctime>
 #include <endian.h>
 #include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // Todo: tidy up
 
@@ -72,6 +77,98 @@ std::vector<char> float8Converter(const std::string &s) {
     return out;
 }
 
+/**
+ * numeric: int16 ndigits, int16 weight, int16 sign, int16 dscale, then ndigits base-10000
+ * digit groups. Weight is the power of 10000 of the first group; leading and trailing
+ * zero groups are dropped and dscale keeps the declared number of decimal places.
+ */
+std::vector<char> numericConverter(const std::string &s) {
+    if (s.empty()) {
+        throw std::invalid_argument("Empty string for numeric");
+    }
+    const std::uint16_t numericPos = 0x0000;
+    const std::uint16_t numericNeg = 0x4000;
+    const std::uint16_t numericNaN = 0xC000;
+    std::uint16_t sign = numericPos;
+    std::vector<std::int16_t> groups;
+    std::int32_t weight = 0;
+    std::size_t dscale = 0;
+    if (s == "NaN") {
+        sign = numericNaN;
+    } else {
+        std::size_t pos = 0;
+        if (s[0] == '-' || s[0] == '+') {
+            sign = s[0] == '-' ? numericNeg : numericPos;
+            pos++;
+        }
+        const std::size_t dot = s.find('.', pos);
+        const std::size_t intEnd = dot == std::string::npos ? s.size() : dot;
+        const std::size_t fracStart = dot == std::string::npos ? s.size() : dot + 1;
+        if (intEnd == pos && fracStart == s.size()) {
+            throw std::invalid_argument("Invalid numeric format: " + s);
+        }
+        for (std::size_t i = pos; i < s.size(); i++) {
+            if (i != dot && !std::isdigit(static_cast<unsigned char>(s[i]))) {
+                throw std::invalid_argument("Invalid numeric format: " + s);
+            }
+        }
+        // Integer digits group from the decimal point leftwards
+        const std::size_t intLen = intEnd - pos;
+        std::size_t i = pos;
+        std::size_t take = intLen % 4 == 0 ? 4 : intLen % 4;
+        while (i < intEnd) {
+            std::int16_t group = 0;
+            for (std::size_t k = 0; k < take; k++) {
+                group = static_cast<std::int16_t>((group * 10) + (s[i + k] - '0'));
+            }
+            groups.push_back(group);
+            i += take;
+            take = 4;
+        }
+        weight = static_cast<std::int32_t>(groups.size()) - 1;
+        // Fractional digits group rightwards, zero-padding the last group
+        dscale = s.size() - fracStart;
+        for (std::size_t f = fracStart; f < s.size(); f += 4) {
+            std::int16_t group = 0;
+            for (std::size_t k = 0; k < 4; k++) {
+                const std::int16_t digit =
+                    f + k < s.size() ? static_cast<std::int16_t>(s[f + k] - '0') : 0;
+                group = static_cast<std::int16_t>((group * 10) + digit);
+            }
+            groups.push_back(group);
+        }
+        std::size_t first = 0;
+        while (first < groups.size() && groups[first] == 0) {
+            first++;
+            weight--;
+        }
+        std::size_t last = groups.size();
+        while (last > first && groups[last - 1] == 0) {
+            last--;
+        }
+        groups = std::vector<std::int16_t>(groups.begin() + static_cast<long>(first),
+                                           groups.begin() + static_cast<long>(last));
+        if (groups.empty()) {
+            weight = 0;
+            sign = numericPos; // Postgres has no negative zero
+        }
+    }
+    if (dscale > 0x3FFF || weight < -32768 || weight > 32767) {
+        throw std::out_of_range("Value out of range for numeric: " + s);
+    }
+    const std::uint16_t header[4] = {
+        htons(static_cast<std::uint16_t>(groups.size())),
+        htons(static_cast<std::uint16_t>(static_cast<std::int16_t>(weight))),
+        htons(sign), htons(static_cast<std::uint16_t>(dscale))};
+    std::vector<char> out(8 + (2 * groups.size()));
+    memcpy(out.data(), header, 8);
+    for (std::size_t g = 0; g < groups.size(); g++) {
+        const std::uint16_t be = htons(static_cast<std::uint16_t>(groups[g]));
+        memcpy(out.data() + 8 + (2 * g), &be, 2);
+    }
+    return out;
+}
+
 /**
  * Convert to lowercase and check against 'thruthy' strings
  */
@@ -101,6 +198,11 @@ std::vector<char> textConverter(const std::string &s) {
     return std::vector<char>(s.begin(), s.end());
 }
 
+// bytea (raw bytes, sent as-is)
+std::vector<char> byteaConverter(const std::string &s) {
+    return std::vector<char>(s.begin(), s.end());
+}
+
 // Date (4 bytes - days since 2000-01-01)
 std::vector<char> dateConverter(const std::string &s) {
     if (s.empty()) {
@@ -176,15 +278,19 @@ std::vector<char> timestampConverter(const std::string &s) {
 }
 
 /**
- * UTC microseconds since 2000-01-01
+ * UTC microseconds since 2000-01-01.
+ * Values without an explicit offset are UTC unless a source zone is given, in which
+ * case they are local wall-clock times in that zone.
  */
-std::vector<char> timestamptzConverter(const std::string &s) {
+static std::vector<char> encodeTimestamptz(const std::string &s, const TimeZone *zone,
+                                           std::size_t &hint) {
     if (s.empty()) {
         throw std::invalid_argument("Empty string for timestamptz");
     }
     std::tm tm = {};
     std::int32_t microseconds = 0;
     std::int32_t tzOffset = 0; // Offset in seconds
+    bool hasOffset = false;
     const char *remaining =
         strptime(s.c_str(), "%Y-%m-%d %H:%M:%S", &tm); // DateTime "YYYY-MM-DD HH:MM:SS"
     if (!remaining) {
@@ -213,6 +319,7 @@ std::vector<char> timestamptzConverter(const std::string &s) {
         if (*remaining == 'Z') {
             // UTC indicator
             tzOffset = 0;
+            hasOffset = true;
         } else if (*remaining == '+' || *remaining == '-') {
             const char sign = *remaining;
             remaining++;
@@ -242,8 +349,8 @@ std::vector<char> timestamptzConverter(const std::string &s) {
             if (sign == '-') {
                 tzOffset = -tzOffset;
             }
+            hasOffset = true;
         }
-        // If no timezone info, assume UTC
     }
     /**
      * Convert to UTC by subtracting the timezone offset
@@ -251,7 +358,7 @@ std::vector<char> timestamptzConverter(const std::string &s) {
      * To get UTC: 14:30:25 - 05:00 = 09:30:25 UTC
      */
     const time_t t = timegm(&tm); // Seconds since 1970 UTC
-    const time_t utc = t - tzOffset;
+    const time_t utc = (!hasOffset && zone) ? zone->toUTC(t, hint) : t - tzOffset;
     /**
      * PostgreSQL epoch starts 2000-01-01
      * So remove the seconds between 1970 and 2000
@@ -265,138 +372,296 @@ std::vector<char> timestamptzConverter(const std::string &s) {
     return out;
 }
 
+std::vector<char> timestamptzConverter(const std::string &s) {
+    std::size_t hint = 0;
+    return encodeTimestamptz(s, nullptr, hint);
+}
+
+// Each converter keeps its own cached zone interval, so build one per column
+Converter zonedTimestamptzConverter(const std::shared_ptr<const TimeZone> &zone) {
+    return [zone, hint = std::size_t{0}](const std::string &s) mutable {
+        return encodeTimestamptz(s, zone.get(), hint);
+    };
+}
+
+/**
+ * Fast paths for columns introspection knows are MariaDB DATE, DATETIME(n) or
+ * TIMESTAMP(n): the server always renders those at a fixed width, so fields sit at
+ * fixed offsets and days come from civil-calendar arithmetic instead of strptime and
+ * timegm. Anything else, such as zero dates, takes the general converter.
+ */
+
+// Digits s[0..n) as a number, or -1 if any is not a digit
+static std::int32_t fixedDigits(const char *s, const std::size_t n) {
+    std::int32_t v = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        const unsigned d = static_cast<unsigned char>(s[i]) - '0';
+        if (d > 9) {
+            return -1;
+        }
+        v = v * 10 + static_cast<std::int32_t>(d);
+    }
+    return v;
+}
+
+// Days since 2000-01-01 of "YYYY-MM-DD" at s, or false; out-of-range days roll over
+static bool fixedDays(const char *s, std::int64_t &days) {
+    const std::int32_t y = fixedDigits(s, 4);
+    const std::int32_t m = fixedDigits(s + 5, 2);
+    const std::int32_t d = fixedDigits(s + 8, 2);
+    if (s[4] != '-' || s[7] != '-' || y < 0 || m < 1 || m > 12 || d < 1 || d > 31) {
+        return false;
+    }
+    // Howard Hinnant's days_from_civil, shifted to the PostgreSQL epoch
+    const std::int32_t yy = y - (m <= 2 ? 1 : 0);
+    const std::int32_t era = (yy >= 0 ? yy : yy - 399) / 400;
+    const std::int32_t yoe = yy - era * 400;
+    const std::int32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const std::int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    days = static_cast<std::int64_t>(era) * 146097 + doe - 719468 - 10957;
+    return true;
+}
+
+std::vector<char> fixedDateConverter(const std::string &s) {
+    std::int64_t days = 0;
+    if (s.size() != 10 || !fixedDays(s.data(), days)) {
+        return dateConverter(s);
+    }
+    const int32_t be = htonl(static_cast<int32_t>(days));
+    std::vector<char> out(4);
+    memcpy(out.data(), &be, 4);
+    return out;
+}
+
+Converter fixedTimestampConverter(const unsigned digits, const bool withZone) {
+    const Converter general = withZone ? timestamptzConverter : timestampConverter;
+    const std::size_t width = digits > 0 ? 20 + digits : 19;
+    return [general, digits, width](const std::string &s) {
+        const char *p = s.data();
+        std::int64_t days = 0;
+        if (s.size() != width || p[10] != ' ' || p[13] != ':' || p[16] != ':' ||
+            (digits > 0 && p[19] != '.') || !fixedDays(p, days)) {
+            return general(s);
+        }
+        const std::int32_t h = fixedDigits(p + 11, 2);
+        const std::int32_t m = fixedDigits(p + 14, 2);
+        const std::int32_t sec = fixedDigits(p + 17, 2);
+        std::int32_t frac = digits > 0 ? fixedDigits(p + 20, digits) : 0;
+        if (h < 0 || h > 23 || m < 0 || m > 59 || sec < 0 || sec > 59 || frac < 0) {
+            return general(s);
+        }
+        for (unsigned i = digits; i < 6; i++) {
+            frac *= 10;
+        }
+        const std::int64_t micros =
+            ((days * 86400) + (h * 3600) + (m * 60) + sec) * 1000000 + frac;
+        const int64_t be = htobe64(micros);
+        std::vector<char> out(8);
+        memcpy(out.data(), &be, 8);
+        return out;
+    };
+}
+
+// Value of every hex digit, 0xFF for anything else
+static constexpr std::array<std::uint8_t, 256> hexTable = []() {
+    std::array<std::uint8_t, 256> t{};
+    for (auto &v : t) {
+        v = 0xFF;
+    }
+    for (int c = 0; c < 10; c++) {
+        t['0' + c] = static_cast<std::uint8_t>(c);
+    }
+    for (int c = 0; c < 6; c++) {
+        t['a' + c] = static_cast<std::uint8_t>(10 + c);
+        t['A' + c] = static_cast<std::uint8_t>(10 + c);
+    }
+    return t;
+}();
+
+// Decode 2n hex digits into n bytes; false on any non-hex character
+static bool decodeHex(const char *in, const std::size_t n, char *out) {
+    for (std::size_t i = 0; i < n; i++) {
+        const std::uint8_t hi = hexTable[static_cast<unsigned char>(in[2 * i])];
+        const std::uint8_t lo = hexTable[static_cast<unsigned char>(in[(2 * i) + 1])];
+        if ((hi | lo) & 0xF0) {
+            return false;
+        }
+        out[i] = static_cast<char>((hi << 4) | lo);
+    }
+    return true;
+}
+
+#if defined(__SSE2__)
+// Decode 32 hex digits into 16 bytes, 16 digits per step
+static bool decodeHex32(const char *in, char *out) {
+    const __m128i zero = _mm_set1_epi8('0' - 1);
+    const __m128i nine = _mm_set1_epi8('9' + 1);
+    const __m128i lowA = _mm_set1_epi8('a' - 1);
+    const __m128i lowF = _mm_set1_epi8('f' + 1);
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    __m128i words[2];
+    for (int half = 0; half < 2; half++) {
+        const __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + (16 * half)));
+        const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const __m128i isDigit =
+            _mm_and_si128(_mm_cmpgt_epi8(v, zero), _mm_cmplt_epi8(v, nine));
+        const __m128i isAlpha =
+            _mm_and_si128(_mm_cmpgt_epi8(lower, lowA), _mm_cmplt_epi8(lower, lowF));
+        if (_mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) != 0xFFFF) {
+            return false;
+        }
+        const __m128i digit = _mm_and_si128(isDigit, _mm_sub_epi8(v, _mm_set1_epi8('0')));
+        const __m128i alpha =
+            _mm_and_si128(isAlpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)));
+        const __m128i nibbles = _mm_or_si128(digit, alpha);
+        // Each little-endian 16-bit lane holds the high digit in its low byte
+        words[half] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, lowMask), 4),
+                                   _mm_srli_epi16(nibbles, 8));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm_packus_epi16(words[0], words[1]));
+    return true;
+}
+#else
+static bool decodeHex32(const char *in, char *out) { return decodeHex(in, 16, out); }
+#endif
+
+/**
+ * macaddr in every layout PostgreSQL accepts: six 1-2 digit groups split by ':' or '-',
+ * 0800.2b01.0203, 0800-2b01-0203, 08002b:010203, 08002b-010203 and 08002b010203.
+ */
 std::vector<char> macaddrConverter(const std::string &s) {
     if (s.empty()) {
         throw std::invalid_argument("Empty string for macaddr");
     }
     std::vector<char> out(6);
-    std::uint32_t bytes[6];
-    const std::int32_t matched =
-        sscanf(s.c_str(),
-               "%x:%x:%x:%x:%x:%x", // Read hex characters (1 byte each)
-               &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]);
-    if (matched != 6) {
+    const std::size_t sz = s.size();
+    const char *p = s.data();
+    const auto colons = std::count(s.begin(), s.end(), ':');
+    const auto dashes = std::count(s.begin(), s.end(), '-');
+    bool ok = false;
+    if (colons == 5 || dashes == 5) {
+        const char sep = colons == 5 ? ':' : '-';
+        std::size_t group = 0;
+        std::size_t digits = 0;
+        unsigned value = 0;
+        ok = true;
+        for (std::size_t i = 0; i <= sz && ok; i++) {
+            if (i == sz || p[i] == sep) {
+                ok = digits > 0 && group < 6;
+                if (ok) {
+                    out[group++] = static_cast<char>(value);
+                }
+                digits = 0;
+                value = 0;
+                continue;
+            }
+            const std::uint8_t v = hexTable[static_cast<unsigned char>(p[i])];
+            ok = v != 0xFF && ++digits <= 2;
+            value = (value << 4) | v;
+        }
+        ok = ok && group == 6;
+    } else if (sz == 12) {
+        ok = decodeHex(p, 6, out.data());
+    } else if (sz == 13 && (p[6] == ':' || p[6] == '-')) {
+        ok = decodeHex(p, 3, out.data()) && decodeHex(p + 7, 3, out.data() + 3);
+    } else if (sz == 14 && (p[4] == '.' || p[4] == '-') && p[9] == p[4]) {
+        ok = decodeHex(p, 2, out.data()) && decodeHex(p + 5, 2, out.data() + 2) &&
+             decodeHex(p + 10, 2, out.data() + 4);
+    }
+    if (!ok) {
         throw std::invalid_argument("Invalid MAC address format: " + s);
     }
-    for (size_t i = 0; i < 6; i++) {
-        out[i] = static_cast<char>(bytes[i]);
-    }
     return out;
 }
 
 /**
- * uuid (16 bytes)
- * Todo: Handle different uuid formats
+ * uuid (16 bytes) from 32 hex digits, optionally hyphenated 8-4-4-4-12 and optionally
+ * wrapped in braces, in either case. The canonical form is compacted to its 32 digits
+ * first so both layouts share one decoder.
  */
 std::vector<char> uuidConverter(const std::string &s) {
-    const std::size_t sz = s.size();
+    std::size_t sz = s.size();
     if (sz == 0) {
         throw std::invalid_argument("Empty string for uuid");
     }
-    std::vector<char> out(16);
-    std::uint32_t bytes[16];
-    std::int32_t matched = 0;
-    if (sz == 36 && s[8] == '-' && s[13] == '-' && s[18] == '-' && s[23] == '-') {
-        matched =
-            sscanf(s.c_str(), "%2x%2x%2x%2x-%2x%2x-%2x%2x-%2x%2x-%2x%2x%2x%2x%2x%2x",
-                   &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5],
-                   &bytes[6], &bytes[7], &bytes[8], &bytes[9], &bytes[10], &bytes[11],
-                   &bytes[12], &bytes[13], &bytes[14], &bytes[15]);
+    const char *p = s.data();
+    if (sz >= 2 && p[0] == '{' && p[sz - 1] == '}') {
+        p++;
+        sz -= 2;
+    }
+    char digits[32];
+    if (sz == 36 && p[8] == '-' && p[13] == '-' && p[18] == '-' && p[23] == '-') {
+        memcpy(digits, p, 8);
+        memcpy(digits + 8, p + 9, 4);
+        memcpy(digits + 12, p + 14, 4);
+        memcpy(digits + 16, p + 19, 4);
+        memcpy(digits + 20, p + 24, 12);
     } else if (sz == 32) {
-        matched =
-            sscanf(s.c_str(), "%2x%2x%2x%2x-%2x%2x-%2x%2x-%2x%2x-%2x%2x%2x%2x%2x%2x",
-                   &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5],
-                   &bytes[6], &bytes[7], &bytes[8], &bytes[9], &bytes[10], &bytes[11],
-                   &bytes[12], &bytes[13], &bytes[14], &bytes[15]);
+        memcpy(digits, p, 32);
     } else {
         throw std::invalid_argument("Invalid UUID length: " + s);
     }
-    if (matched != 16) {
+    std::vector<char> out(16);
+    if (!decodeHex32(digits, out.data())) {
         throw std::invalid_argument("Invalid UUID format: " + s);
     }
-    for (std::size_t i = 0; i < 16; i++) {
-        out[i] = static_cast<char>(bytes[i]);
-    }
     return out;
 }
 
-// json / jsonb (stored as text, PostgreSQL handles parsing)
+// json (stored as text, PostgreSQL handles parsing)
 std::vector<char> jsonConverter(const std::string &s) { return textConverter(s); }
 
-// inet (IP address: 1 byte family + 1 byte bits + 1 byte is_cidr + 1 byte len + address)
+// jsonb (1 byte format version, then the json text)
+std::vector<char> jsonbConverter(const std::string &s) {
+    std::vector<char> out;
+    out.reserve(s.size() + 1);
+    out.push_back(1);
+    out.insert(out.end(), s.begin(), s.end());
+    return out;
+}
+
+/**
+ * inet: 1 byte family, 1 byte prefix bits, 1 byte is_cidr, 1 byte length, then the
+ * address in network order. inet_pton parses straight into the output, so IPv6 gets
+ * :: compression and embedded IPv4 (::ffff:10.0.0.1) for free.
+ */
 std::vector<char> inetConverter(const std::string &s) {
     if (s.empty()) {
         throw std::invalid_argument("Empty string for inet");
     }
-    const bool is_ipv6 = (s.find(':') != std::string::npos);
-    std::string ip = s;
+    const bool isV6 = s.find(':') != std::string::npos;
     const std::size_t slashPos = s.find('/');
     const bool isCIDR = slashPos != std::string::npos;
+    const std::size_t addrLen = isCIDR ? slashPos : s.size();
+    const int maxBits = isV6 ? 128 : 32;
+    int bits = maxBits;
     if (isCIDR) {
-        ip = s.substr(0, slashPos);
-    }
-    if (!is_ipv6) {
-        // IPv4: "192.168.1.1" or "192.168.1.0/24"
-        std::int32_t cidr = 32;
-        if (isCIDR) {
-            cidr = std::stoi(s.substr(slashPos + 1));
-            if (cidr < 0 || cidr > 32) {
-                throw std::invalid_argument("Invalid CIDR bits for IPv4: " + s);
-            }
+        const char *end = s.data() + s.size();
+        const auto [ptr, ec] = std::from_chars(s.data() + slashPos + 1, end, bits);
+        if (ec != std::errc() || ptr != end || bits < 0 || bits > maxBits) {
+            throw std::invalid_argument("Invalid CIDR bits: " + s);
         }
-        std::uint32_t a, b, c, d;
-        if (sscanf(ip.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) != 4) {
-            throw std::invalid_argument("Invalid IPv4 format: " + s);
-        }
-        if (a > 255 || b > 255 || c > 255 || d > 255) {
-            throw std::invalid_argument("Invalid IPv4 octets: " + s);
-        }
-        std::vector<char> out;
-        out.push_back(2); // AF_INET
-        out.push_back(static_cast<char>(cidr));
-        out.push_back(isCIDR ? 1 : 0);
-        out.push_back(4); // address length
-        out.push_back(static_cast<char>(a));
-        out.push_back(static_cast<char>(b));
-        out.push_back(static_cast<char>(c));
-        out.push_back(static_cast<char>(d));
-        return out;
-    } else {
-        // IPv6
-        std::int32_t cidr = 128;
-        if (isCIDR) {
-            cidr = std::stoi(s.substr(slashPos + 1));
-            if (cidr < 0 || cidr > 128) {
-                throw std::invalid_argument("Invalid CIDR bits for IPv6: " + s);
-            }
-        }
-        // Parse IPv6 - full notation only (no :: compression support)
-        std::uint32_t parts[8];
-        std::int32_t matched =
-            sscanf(ip.c_str(), "%x:%x:%x:%x:%x:%x:%x:%x", &parts[0], &parts[1], &parts[2],
-                   &parts[3], &parts[4], &parts[5], &parts[6], &parts[7]);
-        if (matched != 8) {
-            throw std::invalid_argument(
-                "Invalid IPv6 format (only full notation supported): " + s);
-        }
-        for (std::int32_t i = 0; i < 8; i++) {
-            if (parts[i] > 0xFFFF) {
-                throw std::invalid_argument("Invalid IPv6 part value: " + s);
-            }
-        }
-        std::vector<char> out;
-        out.push_back(3); // AF_INET6
-        out.push_back(static_cast<char>(cidr));
-        out.push_back(isCIDR ? 1 : 0);
-        out.push_back(16); // address length
-        for (std::int32_t i = 0; i < 8; i++) {
-            const uint16_t part = static_cast<uint16_t>(parts[i]);
-            const uint16_t be = htons(part);
-            out.push_back(static_cast<char>(be >> 8));
-            out.push_back(static_cast<char>(be & 0xFF));
-        }
-        return out;
     }
+    char addr[INET6_ADDRSTRLEN];
+    if (addrLen >= sizeof(addr)) {
+        throw std::invalid_argument("Invalid IP address: " + s);
+    }
+    memcpy(addr, s.data(), addrLen);
+    addr[addrLen] = '\0';
+    const std::size_t bytes = isV6 ? 16 : 4;
+    std::vector<char> out(4 + bytes);
+    out[0] = isV6 ? 3 : 2; // PGSQL_AF_INET6 / PGSQL_AF_INET
+    out[1] = static_cast<char>(bits);
+    out[2] = isCIDR ? 1 : 0;
+    out[3] = static_cast<char>(bytes);
+    if (inet_pton(isV6 ? AF_INET6 : AF_INET, addr, out.data() + 4) != 1) {
+        throw std::invalid_argument(std::string(isV6 ? "Invalid IPv6 format: "
+                                                     : "Invalid IPv4 format: ") +
+                                    s);
+    }
+    return out;
 }
 
 // enum types (store as text - PostgreSQL maps to enum internally)
@@ -407,11 +672,271 @@ std::vector<char> enumConverter(const std::string &s) {
     return textConverter(s);
 }
 
+/**
+ * One-dimensional arrays: ndim, has-null flag and element OID, then the dimension's
+ * length and lower bound, then each element length-prefixed with -1 for NULL. An empty
+ * array has ndim 0 and no dimension. Elements are written as the source is split and
+ * the count and null flag are patched into the header afterwards, so one pass does it.
+ */
+static constexpr std::int32_t textOid = 25;
+static constexpr std::int32_t int8Oid = 20;
+
+struct ArrayOut {
+    std::vector<char> out;
+    std::int32_t count = 0;
+    bool hasNull = false;
+
+    explicit ArrayOut(const std::int32_t oid) : out(20) {
+        put(8, oid);
+        put(16, 1);
+    }
+    void put(const std::size_t at, const std::int32_t v) {
+        const int32_t be = htonl(v);
+        memcpy(out.data() + at, &be, 4);
+    }
+    // Reserves the element's length prefix; end() fills it in
+    std::size_t begin() {
+        count++;
+        out.resize(out.size() + 4);
+        return out.size();
+    }
+    void end(const std::size_t start) {
+        put(start - 4, static_cast<std::int32_t>(out.size() - start));
+    }
+    void null() {
+        put(begin() - 4, -1);
+        hasNull = true;
+    }
+    std::vector<char> finish() {
+        if (count == 0) {
+            out.resize(12);
+        }
+        put(0, count == 0 ? 0 : 1);
+        put(4, hasNull ? 1 : 0);
+        if (count > 0) {
+            put(12, count);
+        }
+        return std::move(out);
+    }
+};
+
+enum class ArrayItem { VALUE, STRING, NUL };
+
+static bool isJsonSpace(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * Calls visit(kind, p, n) per element of a JSON array, p still escaped for strings, or
+ * per comma-separated member of anything else (SET members cannot contain commas).
+ * Nested arrays and objects are rejected.
+ */
+template <typename Visit> static void splitArray(const std::string &s, Visit &&visit) {
+    const char *p = s.data();
+    const char *end = p + s.size();
+    while (p < end && isJsonSpace(*p)) {
+        p++;
+    }
+    if (p == end || *p != '[') {
+        for (const char *at = s.data(); at <= end;) {
+            const char *comma = static_cast<const char *>(
+                memchr(at, ',', static_cast<std::size_t>(end - at)));
+            const char *stop = comma ? comma : end;
+            visit(ArrayItem::VALUE, at, static_cast<std::size_t>(stop - at));
+            at = stop + 1;
+        }
+        return;
+    }
+    p++;
+    const auto skip = [&]() {
+        while (p < end && isJsonSpace(*p)) {
+            p++;
+        }
+    };
+    skip();
+    if (p < end && *p == ']') {
+        p++;
+    } else {
+        for (;;) {
+            skip();
+            if (p == end) {
+                throw std::invalid_argument("Unterminated JSON array: " + s);
+            }
+            const char *start = p;
+            if (*p == '"') {
+                start = ++p;
+                while (p < end && *p != '"') {
+                    p += *p == '\\' ? 2 : 1;
+                }
+                if (p >= end) {
+                    throw std::invalid_argument("Unterminated JSON string: " + s);
+                }
+                visit(ArrayItem::STRING, start, static_cast<std::size_t>(p++ - start));
+            } else {
+                while (p < end && *p != ',' && *p != ']' && !isJsonSpace(*p)) {
+                    p++;
+                }
+                const auto n = static_cast<std::size_t>(p - start);
+                if (n == 0 || *start == '[' || *start == '{') {
+                    throw std::invalid_argument("Unsupported JSON array element: " + s);
+                }
+                const bool isNull = n == 4 && memcmp(start, "null", 4) == 0;
+                visit(isNull ? ArrayItem::NUL : ArrayItem::VALUE, start, n);
+            }
+            skip();
+            if (p < end && *p == ',') {
+                p++;
+            } else if (p < end && *p == ']') {
+                p++;
+                break;
+            } else {
+                throw std::invalid_argument("Invalid JSON array: " + s);
+            }
+        }
+    }
+    skip();
+    if (p != end) {
+        throw std::invalid_argument("Trailing data after JSON array: " + s);
+    }
+}
+
+static void appendUtf8(std::vector<char> &out, const std::uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+static std::uint32_t hex4(const char *p, const char *end) {
+    std::uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        const std::uint8_t d =
+            p + i < end ? hexTable[static_cast<unsigned char>(p[i])] : 0xFF;
+        if (d == 0xFF) {
+            throw std::invalid_argument("Invalid JSON \\u escape");
+        }
+        v = (v << 4) | d;
+    }
+    return v;
+}
+
+// A JSON string body with its escapes decoded; surrogate pairs must be complete
+static void appendJsonString(std::vector<char> &out, const char *p, const std::size_t n) {
+    const char *end = p + n;
+    while (p < end) {
+        const char *bs = static_cast<const char *>(
+            memchr(p, '\\', static_cast<std::size_t>(end - p)));
+        const char *stop = bs ? bs : end;
+        out.insert(out.end(), p, stop);
+        if (!bs) {
+            return;
+        }
+        p = bs + 2; // The splitter guarantees a character follows
+        switch (bs[1]) {
+        case 'b':
+            out.push_back('\b');
+            break;
+        case 'f':
+            out.push_back('\f');
+            break;
+        case 'n':
+            out.push_back('\n');
+            break;
+        case 'r':
+            out.push_back('\r');
+            break;
+        case 't':
+            out.push_back('\t');
+            break;
+        case 'u': {
+            std::uint32_t cp = hex4(p, end);
+            p += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' &&
+                p[1] == 'u') {
+                const std::uint32_t low = hex4(p + 2, end);
+                if (low >= 0xDC00 && low <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+            }
+            if (cp == 0 || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                throw std::invalid_argument("JSON \\u escape is NUL or a lone surrogate");
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default:
+            out.push_back(bs[1]); // \" \\ and \/
+        }
+    }
+}
+
+std::vector<char> textArrayConverter(const std::string &s) {
+    ArrayOut array(textOid);
+    splitArray(s, [&](const ArrayItem kind, const char *p, const std::size_t n) {
+        if (kind == ArrayItem::NUL) {
+            array.null();
+            return;
+        }
+        const std::size_t start = array.begin();
+        if (kind == ArrayItem::STRING) {
+            appendJsonString(array.out, p, n);
+        } else {
+            array.out.insert(array.out.end(), p, p + n);
+        }
+        array.end(start);
+    });
+    return array.finish();
+}
+
+std::vector<char> int64ArrayConverter(const std::string &s) {
+    ArrayOut array(int8Oid);
+    splitArray(s, [&](const ArrayItem kind, const char *p, const std::size_t n) {
+        if (kind == ArrayItem::NUL) {
+            array.null();
+            return;
+        }
+        std::int64_t v = 0;
+        const auto [ptr, ec] = std::from_chars(p, p + n, v);
+        if (kind == ArrayItem::STRING || ec != std::errc() || ptr != p + n) {
+            throw std::invalid_argument("Invalid int8 array element: " +
+                                        std::string(p, n));
+        }
+        const std::size_t start = array.begin();
+        const int64_t be = htobe64(v);
+        array.out.insert(array.out.end(), reinterpret_cast<const char *>(&be),
+                         reinterpret_cast<const char *>(&be) + 8);
+        array.end(start);
+    });
+    return array.finish();
+}
+
 std::vector<char> makeBinaryRow(
     const std::vector<Field> &row, const std::map<std::string, PgType> &mapping,
-    const std::unordered_map<
-        PgType, std::function<std::vector<char>(const std::string &)>> &converters) {
+    const std::unordered_map<PgType, Converter> &converters,
+    std::vector<ConvertCache> *caches, const std::vector<Converter> *overrides) {
     std::vector<char> out;
+    appendBinaryRow(out, row, mapping, converters, caches, overrides);
+    return out;
+}
+
+// Appends, so a caller reusing out keeps its capacity from row to row
+void appendBinaryRow(std::vector<char> &out, const std::vector<Field> &row,
+                     const std::map<std::string, PgType> &mapping,
+                     const std::unordered_map<PgType, Converter> &converters,
+                     std::vector<ConvertCache> *caches,
+                     const std::vector<Converter> *overrides) {
     int16_t ncols = htons(static_cast<int16_t>(mapping.size()));
     out.insert(out.end(), reinterpret_cast<char *>(&ncols),
                reinterpret_cast<char *>(&ncols) + 2);
@@ -425,8 +950,31 @@ std::vector<char> makeBinaryRow(
         }
         try {
             const auto &t = mapping.at(row[i].column);
-            const auto &converter = converters.at(t); // Will throw if it doesn't exist
-            const auto &buf = converter(val);
+            if (t == PgType::BYTEA) {
+                // Zero-copy pass-through: the field bytes go straight into the row
+                int32_t len = htonl(static_cast<int32_t>(val.size()));
+                out.insert(out.end(), reinterpret_cast<char *>(&len),
+                           reinterpret_cast<char *>(&len) + 4);
+                out.insert(out.end(), val.begin(), val.end());
+                continue;
+            }
+            ConvertCache *cache = caches ? &(*caches)[i] : nullptr;
+            const std::vector<char> *hit = cache ? cache->find(val) : nullptr;
+            std::vector<char> converted;
+            if (!hit) {
+                const auto &converter = overrides && (*overrides)[i]
+                                            ? (*overrides)[i]
+                                            : converters.at(t); // Throws if missing
+                try {
+                    converted = converter(val);
+                } catch (const std::exception &e) {
+                    throw ConversionError(row[i].column, e.what());
+                }
+                if (cache) {
+                    cache->store(val, converted);
+                }
+            }
+            const std::vector<char> &buf = hit ? *hit : converted;
             int32_t len = htonl(static_cast<int32_t>(buf.size()));
             out.insert(out.end(), reinterpret_cast<char *>(&len),
                        reinterpret_cast<char *>(&len) + 4);
@@ -435,7 +983,6 @@ std::vector<char> makeBinaryRow(
             throw std::runtime_error("Unknown column: " + val);
         }
     }
-    return out;
 }
 
 std::vector<char> makeBinaryHeader() {
@@ -0,0 +1,151 @@
+#include "control.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+ControlServer::ControlServer(const std::string &socketPath, Throttle &t, WorkerGate &g,
+                             const std::size_t workers,
+                             std::function<std::string()> report)
+    : path(socketPath), throttle(t), gate(g), maxWorkers(workers),
+      progress(std::move(report)) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Control socket path too long: " + path);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Control socket failed: ") +
+                                 std::strerror(errno));
+    }
+    // A socket left behind by a killed run would make bind fail; anything else is kept
+    struct stat existing = {};
+    if (lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            close(fd);
+            throw std::runtime_error("Control socket path exists and is not a socket: " +
+                                     path);
+        }
+        unlink(path.c_str());
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        chmod(path.c_str(), S_IRUSR | S_IWUSR) < 0 || listen(fd, 4) < 0) {
+        const std::string error = "Control socket " + path + ": " + std::strerror(errno);
+        close(fd);
+        throw std::runtime_error(error);
+    }
+    thread = std::thread([this]() { serve(); });
+}
+
+ControlServer::~ControlServer() {
+    stopping = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    close(fd);
+    unlink(path.c_str());
+}
+
+void ControlServer::serve() {
+    while (!stopping) {
+        // Wakes regularly so shutdown never waits on a client
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 200) <= 0) {
+            continue;
+        }
+        const int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        const timeval timeout = {1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::string line;
+        char buf[256];
+        ssize_t n;
+        while (line.find('\n') == std::string::npos && line.size() < 1024 &&
+               (n = read(client, buf, sizeof(buf))) > 0) {
+            line.append(buf, static_cast<std::size_t>(n));
+        }
+        line = line.substr(0, line.find('\n'));
+        const std::string reply = handle(line);
+        const ssize_t sent = write(client, reply.data(), reply.size());
+        static_cast<void>(sent); // A client that hung up early misses its reply
+        close(client);
+    }
+}
+
+// A count with an optional k, M or G (powers of 1024) suffix
+static double parseAmount(const std::string &s) {
+    std::size_t used = 0;
+    double v = std::stod(s, &used);
+    const std::string suffix = s.substr(used);
+    if (suffix == "k" || suffix == "K") {
+        v *= 1024;
+    } else if (suffix == "M") {
+        v *= 1024 * 1024;
+    } else if (suffix == "G") {
+        v *= 1024.0 * 1024 * 1024;
+    } else if (!suffix.empty()) {
+        throw std::invalid_argument(s);
+    }
+    if (v < 0) {
+        throw std::invalid_argument(s);
+    }
+    return v;
+}
+
+std::string ControlServer::handle(const std::string &line) {
+    std::istringstream in(line);
+    std::string cmd;
+    std::string arg;
+    in >> cmd >> arg;
+    try {
+        if (cmd == "stats") {
+            return stats();
+        }
+        if (cmd == "rows" && !arg.empty()) {
+            throttle.setLimits(parseAmount(arg), throttle.byteLimit());
+            return "ok\n";
+        }
+        if (cmd == "bytes" && !arg.empty()) {
+            throttle.setLimits(throttle.rowLimit(), parseAmount(arg));
+            return "ok\n";
+        }
+        if (cmd == "workers" && !arg.empty()) {
+            const auto n = static_cast<std::size_t>(parseAmount(arg));
+            gate.setLimit(std::min(n, maxWorkers));
+            return n > maxWorkers ? "ok, capped at " + std::to_string(maxWorkers) + "\n"
+                                  : "ok\n";
+        }
+    } catch (const std::exception &) {
+        return "error: bad number: " + arg + "\n";
+    }
+    const std::string usage = "stats, rows <n>, bytes <n>[k|M|G] or workers <n>\n";
+    return cmd == "help" ? usage : "error: expected " + usage;
+}
+
+std::string ControlServer::stats() {
+    const auto now = std::chrono::steady_clock::now();
+    const std::uint64_t rows = throttle.rows();
+    const std::uint64_t bytes = throttle.bytes();
+    const double secs = std::chrono::duration<double>(now - lastAt).count();
+    std::ostringstream out;
+    out << progress() << "rows " << rows << "\nbytes " << bytes
+        << "\nrows_per_sec " << static_cast<double>(rows - lastRows) / secs
+        << "\nbytes_per_sec " << static_cast<double>(bytes - lastBytes) / secs
+        << "\nrow_limit " << throttle.rowLimit() << "\nbyte_limit "
+        << throttle.byteLimit() << "\nworkers " << gate.active() << "/"
+        << gate.limit() << "\n";
+    lastAt = now;
+    lastRows = rows;
+    lastBytes = bytes;
+    return out.str();
+}
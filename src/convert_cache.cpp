@@ -0,0 +1,76 @@
+#include "convert_cache.hpp"
+#include <functional>
+
+ConvertCache::ConvertCache(const bool enabled) : on(enabled) {
+    if (on) {
+        table.resize(slots);
+    }
+}
+
+ConvertCache::Slot &ConvertCache::slotFor(const std::string &key) {
+    return table[std::hash<std::string>{}(key) & (slots - 1)];
+}
+
+const std::vector<char> *ConvertCache::find(const std::string &key) {
+    if (!on) {
+        return nullptr;
+    }
+    const Slot &slot = slotFor(key);
+    const bool hit = slot.used && slot.key == key;
+    (hit ? nHits : nMisses)++;
+    windowLookups++;
+    windowHits += hit ? 1 : 0;
+    if (windowLookups >= window) {
+        if (windowHits < minHitsPerWindow) {
+            // Mostly unique values: stop hashing and give the memory back
+            on = false;
+            std::vector<Slot>().swap(table);
+            return nullptr;
+        }
+        windowLookups = 0;
+        windowHits = 0;
+    }
+    return hit ? &slot.value : nullptr;
+}
+
+void ConvertCache::store(const std::string &key, const std::vector<char> &value) {
+    if (!on || key.size() > maxKeySize) {
+        return;
+    }
+    Slot &slot = slotFor(key);
+    slot.key = key;
+    slot.value = value;
+    slot.used = true;
+}
+
+bool ConvertCache::enabled() const { return on; }
+
+std::uint64_t ConvertCache::hits() const { return nHits; }
+
+std::uint64_t ConvertCache::misses() const { return nMisses; }
+
+/**
+ * Only types whose conversion costs more than copying the cached bytes back out.
+ * Text-like and pass-through types are cheaper to convert than to look up.
+ */
+bool isCacheable(const PgType t) {
+    switch (t) {
+    case PgType::INT16:
+    case PgType::INT32:
+    case PgType::INT64:
+    case PgType::FLOAT4:
+    case PgType::FLOAT8:
+    case PgType::NUMERIC:
+    case PgType::BOOL:
+    case PgType::DATE:
+    case PgType::TIME:
+    case PgType::TIMESTAMP:
+    case PgType::TIMESTAMPTZ:
+    case PgType::MACADDR:
+    case PgType::UUID:
+    case PgType::INET:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -1,4 +1,35 @@
 #include "db_helper.hpp"
+#include "dead_letter.hpp"
+#include "replicas.hpp"
+#include "snapshot.hpp"
+#include "text.hpp"
+#include "throttle.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+/**
+ * High-water marks live on the destination so a merge and its watermark commit together.
+ */
+static const char *const watermarkDDL =
+    "CREATE TABLE IF NOT EXISTS migrate_watermarks ("
+    "table_name TEXT PRIMARY KEY, high_water TEXT NOT NULL, "
+    "recorded_at TIMESTAMPTZ NOT NULL DEFAULT now())";
+
+static std::once_flag watermarkOnce;
+
+// The server refused a COPY's data on a connection that is still usable
+struct CopyRejected : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
 
 void MysqlDeleter::operator()(MYSQL *mysql) const noexcept {
     if (mysql) {
@@ -18,22 +49,201 @@ void PgDeleter::operator()(PGconn *pg) const noexcept {
     }
 }
 
-DBHelper::DBHelper(const TableConf *conf, const bool _useCSV, const MysqlConfig &mConfig,
-                   const PgsqlConfig &pConfig)
-    : fromTable(conf->tabName), toTable(conf->tabName), mapping(conf->map),
-      useCSV(_useCSV), mysql(nullptr), pg(nullptr), res(nullptr), myConfig(mConfig),
-      pgConfig(pConfig) {
+DBHelper::DBHelper(const TableConf *conf, const RunConfig &rConfig,
+                   const MysqlConfig &mConfig, const PgsqlConfig &pConfig,
+                   const std::optional<KeyRange> &keyRange)
+    : fromTable(conf->sourceTable.empty() ? conf->tabName : conf->sourceTable),
+      toTable(conf->tabName), stagingTable("migrate_delta_" + conf->tabName),
+      toIdent(quoteIdent(toTable)), stagingIdent(quoteIdent(stagingTable)),
+      fromIdent(quoteSourceIdent(fromTable)),
+      mapping(conf->map), sources(conf->sources), ddl(conf->ddl), where(conf->where),
+      keyCol(conf->keyCol), watermarkCol(conf->watermarkCol), useCSV(rConfig.useCSV),
+      incremental(rConfig.incremental), truncateFirst(rConfig.truncateFirst),
+      sampleRows(rConfig.sampleRows),
+      shardBounds(conf->shardBounds), mysql(nullptr),
+      res(nullptr), myConfig(mConfig),
+      pgConfigs(rConfig.shards.empty() ? std::vector<PgsqlConfig>{pConfig}
+                                       : rConfig.shards),
+      maxPartitionStreams(rConfig.maxPartitionStreams),
+      sendBufferSize(rConfig.sendBufferSize), lease(rConfig.budget),
+      deadLetter(rConfig.deadLetter), invalidText(rConfig.invalidText),
+      snapshotPool(rConfig.snapshotPool), throttle(rConfig.throttle), tableConf(conf),
+      runConfig(rConfig), replicas(rConfig.replicas), range(keyRange) {
+    if (incremental && (useCSV || watermarkCol.empty() || keyCol.empty())) {
+        throw std::runtime_error("Incremental mode needs a MariaDB source, a "
+                                 "watermark column and a key column: " +
+                                 fromTable);
+    }
+    if (!conf->shardKey.empty()) {
+        const auto key = mapping.find(conf->shardKey);
+        if (key == mapping.end()) {
+            throw std::runtime_error("Shard key is not a mapped column: " +
+                                     conf->shardKey);
+        }
+        shardCol = static_cast<std::size_t>(std::distance(mapping.begin(), key));
+    }
+    const auto key = mapping.find(keyCol);
+    if (key != mapping.end()) {
+        keyIndex = static_cast<std::size_t>(std::distance(mapping.begin(), key));
+    }
+    if (!shardBounds.empty() && shardBounds.size() + 1 != pgConfigs.size()) {
+        throw std::runtime_error("Range sharding needs one bound fewer than shards: " +
+                                 toTable);
+    }
+    bool zoned = false;
+    bool fixed = false;
+    for (const auto &m : mapping) {
+        const auto col = conf->columnZones.find(m.first);
+        const std::string &zone = col != conf->columnZones.end() ? col->second
+                                  : !conf->sourceZone.empty()   ? conf->sourceZone
+                                                                : rConfig.sourceZone;
+        const auto width = conf->fixedTemporal.find(m.first);
+        if (m.second == PgType::TIMESTAMPTZ && !zone.empty() && zone != "UTC") {
+            overrides.push_back(zonedTimestamptzConverter(TimeZone::load(zone)));
+            zoned = true;
+        } else if (width != conf->fixedTemporal.end() && m.second == PgType::DATE) {
+            overrides.emplace_back(fixedDateConverter);
+            fixed = true;
+        } else if (width != conf->fixedTemporal.end() &&
+                   (m.second == PgType::TIMESTAMP || m.second == PgType::TIMESTAMPTZ)) {
+            overrides.push_back(fixedTimestampConverter(
+                width->second, m.second == PgType::TIMESTAMPTZ));
+            fixed = true;
+        } else {
+            overrides.emplace_back();
+        }
+    }
+    if (!zoned && !fixed) {
+        overrides.clear();
+    }
+    bool hasText = false;
+    for (const auto &m : mapping) {
+        const bool isText = m.second == PgType::TEXT || m.second == PgType::JSON ||
+                            m.second == PgType::JSONB || m.second == PgType::ENUM ||
+                            m.second == PgType::TEXT_ARRAY;
+        const auto col = conf->columnCharsets.find(m.first);
+        const std::string &charset =
+            col != conf->columnCharsets.end() ? col->second
+            : !conf->charset.empty()          ? conf->charset
+                                              : rConfig.sourceCharset;
+        if (isText) {
+            charsets.push_back(parseCharset(charset.empty() ? "utf8" : charset));
+            hasText = true;
+        } else {
+            charsets.emplace_back();
+        }
+    }
+    if (!hasText) {
+        charsets.clear();
+    }
+    rowBuf.reserve(mapping.size());
+    for (const auto &m : mapping) {
+        rowBuf.push_back({m.first, ""});
+    }
+    if (rConfig.convertCache) {
+        caches.reserve(mapping.size());
+        for (const auto &m : mapping) {
+            caches.emplace_back(isCacheable(m.second));
+        }
+    }
+    initPGConnection();
+    if (rConfig.sendBudget > 0) {
+        // Shards and partition leaves each buffer, so they split the worker's share
+        sendBufferSize = std::min(
+            sendBufferSize, std::max<std::size_t>(rConfig.sendBudget / streams.size(),
+                                                  minSendBuffer));
+    }
+    const CopyFormat format = conf->format.value_or(rConfig.format);
+    if (format == CopyFormat::AUTO) {
+        textCopy = chooseCopyFormat(mapping) == CopyFormat::TEXT;
+    } else {
+        textCopy = format == CopyFormat::TEXT;
+    }
+    const bool rawOnly = std::any_of(mapping.begin(), mapping.end(), [](const auto &m) {
+        return m.second == PgType::BYTEA || m.second == PgType::TEXT_ARRAY ||
+               m.second == PgType::INT64_ARRAY;
+    });
+    if (textCopy && (zoned || !partitions.empty() || rawOnly)) {
+        // Source zones, partition routing, raw bytea and arrays need the binary encoders
+        if (!range) {
+            std::cout << toTable << ": text COPY not possible, using binary" << std::endl;
+        }
+        textCopy = false;
+    }
+    if (textCopy && !caches.empty()) {
+        // Text passes values through unconverted, so there is nothing to memoise
+        if (!range) {
+            std::cout << toTable << ": text COPY, so --convert-cache has no effect"
+                      << std::endl;
+        }
+        caches.clear();
+    }
+    if (textCopy) {
+        // Offset-less timestamps are UTC, as on the binary path
+        execPG("SET TIME ZONE 'UTC'", "SET TIME ZONE");
+    }
     if (!useCSV) {
         initMysqlConnection();
     }
-    initPGConnection();
 }
 
-void DBHelper::initMysqlConnection() {
-    mysql.reset(mysql_init(nullptr));
+// The key as the source knows it, for filtering the read on it
+std::string DBHelper::sourceKey() const {
+    const auto source = sources.find(keyCol);
+    return source != sources.end() ? source->second : quoteSourceIdent(keyCol);
+}
+
+std::string DBHelper::columnList() const {
+    std::string cols;
+    std::size_t i = 0;
+    for (const auto &m : mapping) {
+        cols += quoteIdent(m.first);
+        if (i + 1 < mapping.size())
+            cols += ", ";
+        i++;
+    }
+    return cols;
+}
+
+// Destination column order, each replaced by its source column or expression if set
+std::string DBHelper::selectList() const {
+    std::string cols;
+    std::size_t i = 0;
+    for (const auto &m : mapping) {
+        const auto source = sources.find(m.first);
+        cols += source != sources.end() ? source->second : quoteSourceIdent(m.first);
+        if (i + 1 < mapping.size())
+            cols += ", ";
+        i++;
+    }
+    return cols;
+}
+
+PgPtr connectPG(const PgsqlConfig &pgConfig) {
+    const std::string connInfo =
+        "host=" + pgConfig.pghost + " port=" + std::to_string(pgConfig.pgport) +
+        " dbname=" + pgConfig.pgname + " user=" + pgConfig.pguser +
+        " password=" + pgConfig.pgpass;
+
+    std::cout << "PostgreSQL connection info: " << connInfo << std::endl;
+    TRACE_SPAN("connect postgres");
+    PgPtr pg(PQconnectdb(connInfo.c_str()));
+    if (PQstatus(pg.get()) != CONNECTION_OK) {
+        const std::string error =
+            std::string("PostgreSQL connection failed: ") + PQerrorMessage(pg.get());
+        throw std::runtime_error(error);
+    }
+    return pg;
+}
+
+MysqlPtr connectMysql(const MysqlConfig &myConfig) {
+    TRACE_SPAN("connect mariadb");
+    MysqlPtr mysql(mysql_init(nullptr));
     if (!mysql) {
         throw std::runtime_error("mysql_init failed");
     }
+    // Pinned rather than left to the client library, so results arrive as UTF-8
+    mysql_options(mysql.get(), MYSQL_SET_CHARSET_NAME, "utf8mb4");
     if (!mysql_real_connect(mysql.get(), myConfig.myhost.c_str(), myConfig.myuser.c_str(),
                             myConfig.mypass.c_str(), myConfig.myname.c_str(),
                             myConfig.myport, nullptr, 0)) {
@@ -41,20 +251,105 @@ void DBHelper::initMysqlConnection() {
             std::string("MySQL connection failed: ") + mysql_error(mysql.get());
         throw std::runtime_error(error);
     }
-    std::string cols;
-    std::size_t i = 0;
-    for (const auto &m : mapping) {
-        cols += m.first;
-        if (i + 1 < mapping.size())
-            cols += ", ";
-        i++;
-    }
-    std::string querySQL = "SELECT " + cols + " FROM " + fromTable;
-    if (mysql_query(mysql.get(), querySQL.c_str())) {
+    // TIMESTAMP values are rendered in the session zone; the converters read them as UTC
+    if (mysql_query(mysql.get(), "SET time_zone = '+00:00'")) {
         std::string error =
-            std::string("MySQL query failed: ") + mysql_error(mysql.get());
+            std::string("MySQL SET time_zone failed: ") + mysql_error(mysql.get());
         throw std::runtime_error(error);
     }
+    return mysql;
+}
+
+DBHelper::~DBHelper() {
+    // Only a fully drained connection can go back for the next table
+    if (snapshotPool && mysql && !res) {
+        snapshotPool->give(std::move(mysql));
+    }
+    if (replica != noShard) {
+        replicas->release(replica);
+    }
+}
+
+void DBHelper::initMysqlConnection() {
+    if (replicas) {
+        replica = replicas->acquire();
+        myConfig = replicas->config(replica);
+    }
+    // Pooled connections already sit inside the shared snapshot transaction
+    mysql = snapshotPool ? snapshotPool->take() : connectMysql(myConfig);
+    /**
+     * A declared non-UTF-8 charset describes the stored bytes, which the server would
+     * otherwise transcode before we decode them again. Pooled connections carry the
+     * setting over from their previous table, so they are always set.
+     */
+    const bool rawText = std::any_of(charsets.begin(), charsets.end(), [](const auto &c) {
+        return c && *c != Charset::UTF8;
+    });
+    if (rawText || snapshotPool) {
+        const std::string sql = std::string("SET SESSION character_set_results = ") +
+                                (rawText ? "binary" : "utf8mb4");
+        if (mysql_query(mysql.get(), sql.c_str())) {
+            throw std::runtime_error(std::string("MySQL result charset failed: ") +
+                                     mysql_error(mysql.get()));
+        }
+    }
+    if (!watermarkCol.empty() && sampleRows == 0 && !range) {
+        if (incremental) {
+            loadWatermark();
+        }
+        // Taken before the read so rows changed mid-copy land in the next delta
+        highWater = queryHighWater();
+    }
+    const auto key = mapping.find(keyCol);
+    const bool integerKey = key != mapping.end() && (key->second == PgType::INT16 ||
+                                                     key->second == PgType::INT32 ||
+                                                     key->second == PgType::INT64);
+    if (replicas && replicas->size() > 1 && !range && !incremental && sampleRows == 0 &&
+        integerKey) {
+        chunks = splitKeys();
+        if (!chunks.empty()) {
+            // The chunk helpers read on connections of their own
+            replicas->release(std::exchange(replica, noShard));
+            mysql.reset();
+            return;
+        }
+    }
+    std::string querySQL = "SELECT " + selectList() + " FROM " + fromIdent;
+    std::string filter = where.empty() ? "" : "(" + where + ")";
+    if (incremental) {
+        /**
+         * Inclusive bound: rows written in the same second as the previous watermark
+         * are re-sent rather than lost, and the upsert makes re-applying them harmless.
+         */
+        std::string escaped(lowWater.size() * 2 + 1, '\0');
+        escaped.resize(mysql_real_escape_string(mysql.get(), escaped.data(),
+                                                lowWater.c_str(), lowWater.size()));
+        filter +=
+            (filter.empty() ? "" : " AND ") + quoteSourceIdent(watermarkCol) + " >= '" +
+            escaped + "'";
+    }
+    if (range) {
+        std::string span = sourceKey() + " BETWEEN " + std::to_string(range->low) +
+                           " AND " + std::to_string(range->high);
+        if (range->nulls) {
+            span = "(" + span + " OR " + sourceKey() + " IS NULL)";
+        }
+        filter += (filter.empty() ? "" : " AND ") + span;
+    }
+    if (!filter.empty()) {
+        querySQL += " WHERE " + filter;
+    }
+    if (sampleRows > 0) {
+        querySQL += " LIMIT " + std::to_string(sampleRows);
+    }
+    {
+        TRACE_SPAN("query");
+        if (mysql_query(mysql.get(), querySQL.c_str())) {
+            std::string error =
+                std::string("MySQL query failed: ") + mysql_error(mysql.get());
+            throw std::runtime_error(error);
+        }
+    }
     res.reset(mysql_use_result(mysql.get()));
     if (!res) {
         throw std::runtime_error("mysql_use_result failed");
@@ -62,147 +357,1025 @@ void DBHelper::initMysqlConnection() {
 }
 
 void DBHelper::initPGConnection() {
-    const std::string connInfo =
-        "host=" + pgConfig.pghost + " port=" + std::to_string(pgConfig.pgport) +
-        " dbname=" + pgConfig.pgname + " user=" + pgConfig.pguser +
-        " password=" + pgConfig.pgpass;
+    streams.resize(pgConfigs.size());
+    for (std::size_t i = 0; i < pgConfigs.size(); i++) {
+        streams[i].pg = connectPG(pgConfigs[i]);
+    }
+    // Incremental deltas are small and merge through the parent anyway
+    if (pgConfigs.size() == 1 && !incremental && maxPartitionStreams > 0) {
+        discoverPartitions();
+    }
+}
 
-    std::cout << "PostgreSQL connection info: " << connInfo << std::endl;
-    pg.reset(PQconnectdb(connInfo.c_str()));
-    if (PQstatus(pg.get()) != CONNECTION_OK) {
+// Decode the big-endian integer of column col straight from an encoded binary row
+static bool encodedKey(const std::vector<char> &data, const std::size_t col,
+                       std::int64_t &key) {
+    std::size_t at = 2;
+    for (std::size_t i = 0;; i++) {
+        std::int32_t len = 0;
+        memcpy(&len, data.data() + at, 4);
+        len = static_cast<std::int32_t>(ntohl(static_cast<std::uint32_t>(len)));
+        at += 4;
+        if (i == col) {
+            if (len < 0) {
+                return false;
+            }
+            std::uint64_t v = 0;
+            for (std::size_t b = 0; b < static_cast<std::size_t>(len); b++) {
+                v = (v << 8) | static_cast<unsigned char>(data[at + b]);
+            }
+            const std::uint32_t shift = static_cast<std::uint32_t>(64 - (8 * len));
+            key = static_cast<std::int64_t>(v << shift) >> shift; // Sign-extend
+            return true;
+        }
+        at += len > 0 ? static_cast<std::size_t>(len) : 0;
+    }
+}
+
+// One bound from "FOR VALUES FROM (...) TO (...)"; MINVALUE/MAXVALUE map to the extremes
+static std::string boundValue(const std::string &expr, const std::string &keyword) {
+    const std::size_t open = expr.find(keyword + " (");
+    if (open == std::string::npos) {
+        throw std::runtime_error("Unsupported partition bound: " + expr);
+    }
+    const std::size_t start = open + keyword.size() + 2;
+    const std::size_t close = expr.find(')', start);
+    std::string v = expr.substr(start, close - start);
+    if (v.size() >= 2 && v.front() == '\'' && v.back() == '\'') {
+        v = v.substr(1, v.size() - 2);
+    }
+    return v;
+}
+
+/**
+ * Route rows client-side into the leaves of a single-level RANGE-partitioned table,
+ * one COPY stream (and backend) per leaf, instead of letting the parent route every
+ * tuple on one backend. Bounds are encoded with the key column's own converter so rows
+ * are matched on their already-encoded key. Anything else keeps copying into the parent.
+ */
+void DBHelper::discoverPartitions() {
+    PGconn *pg = streams[0].pg.get();
+    // Render timestamptz bounds with an explicit +00 offset
+    execPG("SET TIME ZONE 'UTC'", "SET TIME ZONE");
+    const char *params[1] = {toIdent.c_str()};
+    PGresult *r = PQexecParams(pg,
+                               "SELECT p.partstrat, p.partnatts, a.attname "
+                               "FROM pg_partitioned_table p JOIN pg_attribute a "
+                               "ON a.attrelid = p.partrelid "
+                               "AND a.attnum = p.partattrs[0] "
+                               "WHERE p.partrelid = $1::regclass",
+                               1, nullptr, params, nullptr, nullptr, 0);
+    if (PQresultStatus(r) != PGRES_TUPLES_OK || PQntuples(r) == 0) {
+        PQclear(r);
+        return; // Not partitioned
+    }
+    const std::string strategy = PQgetvalue(r, 0, 0);
+    const std::string nkeys = PQgetvalue(r, 0, 1);
+    const std::string keyName = PQgetvalue(r, 0, 2);
+    PQclear(r);
+    const auto key = mapping.find(keyName);
+    if (strategy != "r" || nkeys != "1" || key == mapping.end()) {
+        std::cout << toTable << ": partition key not routable, copying via parent"
+                  << std::endl;
+        return;
+    }
+    switch (key->second) {
+    case PgType::INT16:
+    case PgType::INT32:
+    case PgType::INT64:
+    case PgType::DATE:
+    case PgType::TIMESTAMP:
+    case PgType::TIMESTAMPTZ:
+        break;
+    default:
+        std::cout << toTable << ": partition key type not routable, copying via parent"
+                  << std::endl;
+        return;
+    }
+    r = PQexecParams(pg,
+                     "SELECT c.oid::regclass::text, c.relkind, "
+                     "pg_get_expr(c.relpartbound, c.oid) FROM pg_inherits i "
+                     "JOIN pg_class c ON c.oid = i.inhrelid "
+                     "WHERE i.inhparent = $1::regclass",
+                     1, nullptr, params, nullptr, nullptr, 0);
+    if (PQresultStatus(r) != PGRES_TUPLES_OK) {
         const std::string error =
-            std::string("PostgreSQL connection failed: ") + PQerrorMessage(pg.get());
+            std::string("Partition discovery failed: ") + PQerrorMessage(pg);
+        PQclear(r);
         throw std::runtime_error(error);
     }
+    const std::size_t leaves = static_cast<std::size_t>(PQntuples(r));
+    bool nested = false;
+    for (std::size_t i = 0; i < leaves; i++) {
+        nested = nested || PQgetvalue(r, static_cast<int>(i), 1)[0] == 'p';
+    }
+    if (leaves == 0 || leaves > maxPartitionStreams || nested) {
+        std::cout << toTable << ": " << leaves
+                  << " partitions not routable, copying via parent" << std::endl;
+        PQclear(r);
+        return;
+    }
+    const Converter &convert = converters.at(key->second);
+    auto encodeBound = [&](const std::string &v) {
+        if (v == "MINVALUE") {
+            return std::numeric_limits<std::int64_t>::min();
+        }
+        if (v == "MAXVALUE") {
+            return std::numeric_limits<std::int64_t>::max();
+        }
+        const std::vector<char> enc = convert(v);
+        std::uint64_t u = 0;
+        for (const char c : enc) {
+            u = (u << 8) | static_cast<unsigned char>(c);
+        }
+        const std::uint32_t shift = static_cast<std::uint32_t>(64 - (8 * enc.size()));
+        return static_cast<std::int64_t>(u << shift) >> shift;
+    };
+    partitionCol = static_cast<std::size_t>(std::distance(mapping.begin(), key));
+    streams.resize(leaves);
+    for (std::size_t i = 0; i < leaves; i++) {
+        const int row = static_cast<int>(i);
+        const std::string bound = PQgetvalue(r, row, 2);
+        if (i > 0) {
+            streams[i].pg = connectPG(pgConfigs[0]);
+            streams[i].primary = false;
+        }
+        streams[i].table = PQgetvalue(r, row, 0);
+        if (bound == "DEFAULT") {
+            defaultPartition = i;
+            continue;
+        }
+        partitions.push_back({encodeBound(boundValue(bound, "FROM")),
+                              encodeBound(boundValue(bound, "TO")), i});
+    }
+    PQclear(r);
+    std::sort(partitions.begin(), partitions.end(),
+              [](const Partition &a, const Partition &b) { return a.low < b.low; });
+    std::cout << toTable << ": routing into " << leaves << " partitions" << std::endl;
 }
 
-void DBHelper::startCopy() {
-    std::string copyCmd = "COPY " + toTable + " (";
-    std::size_t i = 0;
-    for (const auto &m : mapping) {
-        copyCmd += m.first;
-        if (i + 1 < mapping.size())
-            copyCmd += ", ";
-        i++;
+std::size_t DBHelper::partitionFor(const std::vector<char> &data) const {
+    std::int64_t key = 0;
+    if (encodedKey(data, partitionCol, key)) {
+        auto it = std::upper_bound(
+            partitions.begin(), partitions.end(), key,
+            [](const std::int64_t k, const Partition &p) { return k < p.low; });
+        if (it != partitions.begin() && key < (--it)->high) {
+            return it->stream;
+        }
     }
-    copyCmd += ") FROM STDIN BINARY";
-    PGresult *r = PQexec(pg.get(), copyCmd.c_str());
+    if (defaultPartition == noShard) {
+        throw std::runtime_error("No partition of " + toTable + " for row");
+    }
+    return defaultPartition;
+}
+
+// Partition streams copy straight into their leaf instead of the given table
+void DBHelper::startCopy(const std::string &table) {
+    copyTarget = table;
+    if (deadLetter) {
+        return; // Every flushed batch runs a COPY of its own
+    }
+    for (CopyStream &stream : streams) {
+        startCopy(stream.pg.get(), stream.table.empty() ? table : stream.table);
+    }
+}
+
+void DBHelper::startCopy(PGconn *pg, const std::string &table) {
+    const std::string copyCmd = "COPY " + table + " (" + columnList() + ") FROM STDIN" +
+                                (textCopy ? "" : " BINARY");
+    PGresult *r = PQexec(pg, copyCmd.c_str());
     if (PQresultStatus(r) != PGRES_COPY_IN) {
         const std::string error =
-            std::string("COPY start failed: ") + PQerrorMessage(pg.get());
+            std::string("COPY start failed: ") + PQerrorMessage(pg);
         PQclear(r);
         throw std::runtime_error(error);
     }
     PQclear(r);
+    if (textCopy) {
+        return;
+    }
     const auto header = makeBinaryHeader();
-    if (PQputCopyData(pg.get(), header.data(), static_cast<int>(header.size())) <= 0) {
+    if (PQputCopyData(pg, header.data(), static_cast<int>(header.size())) <= 0) {
         const std::string error =
-            std::string("COPY header write failed: ") + PQerrorMessage(pg.get());
+            std::string("COPY header write failed: ") + PQerrorMessage(pg);
         throw std::runtime_error(error);
     }
 }
 
-MYSQL_ROW DBHelper::getMysqlRow() { return mysql_fetch_row(res.get()); }
+MYSQL_ROW DBHelper::getMysqlRow() {
+    TRACE_SPAN("fetch");
+    return mysql_fetch_row(res.get());
+}
+
+/**
+ * Claim budget for one row before materialising it: the field copies, their encoding
+ * (bounded by the raw size plus a fixed width and length prefix per column) and, on
+ * first use, the send buffers. If the budget is exhausted we flush and free the send
+ * buffers before waiting, so a blocked worker never holds bytes another one needs.
+ */
+std::size_t DBHelper::reserveRow(const std::size_t rawBytes, const std::size_t ncols) {
+    const std::size_t transient = (2 * rawBytes) + (ncols * (sizeof(Field) + 20));
+    const std::size_t buffers = sendBufferSize * streams.size();
+    const bool allocated = streams[0].sendBuf.capacity() != 0;
+    if (!lease.tryGrow(transient + (allocated ? 0 : buffers))) {
+        for (CopyStream &stream : streams) {
+            flush(stream);
+            lease.shrink(stream.sendBuf.capacity());
+            std::vector<char>().swap(stream.sendBuf);
+        }
+        TRACE_SPAN("budget wait");
+        lease.grow(transient + buffers);
+    }
+    if (streams[0].sendBuf.capacity() == 0) {
+        for (CopyStream &stream : streams) {
+            stream.sendBuf.reserve(sendBufferSize);
+        }
+    }
+    return transient;
+}
+
+/**
+ * Hash sharding sends integer keys to key mod N and anything else by FNV-1a of its
+ * bytes; range sharding picks the first shard whose upper bound exceeds the key.
+ * NULL keys go to shard 0.
+ */
+std::size_t DBHelper::route(const std::vector<Field> &result) const {
+    const std::string &key = result[shardCol].value;
+    const std::size_t n = streams.size();
+    if (key.empty()) {
+        return 0;
+    }
+    std::int64_t num = 0;
+    const auto [end, ec] = std::from_chars(key.data(), key.data() + key.size(), num);
+    const bool numeric = ec == std::errc() && end == key.data() + key.size();
+    if (!shardBounds.empty()) {
+        if (!numeric) {
+            throw std::invalid_argument("Non-integer range shard key: " + key);
+        }
+        return static_cast<std::size_t>(
+            std::upper_bound(shardBounds.begin(), shardBounds.end(), num) -
+            shardBounds.begin());
+    }
+    if (numeric) {
+        const std::int64_t sn = static_cast<std::int64_t>(n);
+        return static_cast<std::size_t>(((num % sn) + sn) % sn);
+    }
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (const char c : key) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return static_cast<std::size_t>(hash % n);
+}
+
+const std::string &DBHelper::keyOf(const std::vector<Field> &result) const {
+    static const std::string none;
+    return keyIndex == noShard ? none : result[keyIndex].value;
+}
+
+/**
+ * Text is made valid UTF-8 before either encoder sees it, so a bad value fails here
+ * with its column named instead of failing the whole COPY batch on the server.
+ */
+void DBHelper::normaliseText(std::vector<Field> &result) {
+    for (std::size_t i = 0; i < charsets.size(); i++) {
+        if (!charsets[i]) {
+            continue;
+        }
+        try {
+            toUtf8(result[i].value, *charsets[i], invalidText, textScratch);
+        } catch (const std::invalid_argument &e) {
+            throw ConversionError(result[i].column, e.what());
+        }
+    }
+}
+
+const std::vector<char> &DBHelper::encodeRow(std::vector<Field> &result) {
+    TRACE_SPAN("encode");
+    normaliseText(result);
+    encodeBuf.clear();
+    if (textCopy) {
+        appendTextRow(encodeBuf, result);
+    } else {
+        appendBinaryRow(encodeBuf, result, mapping, converters,
+                        caches.empty() ? nullptr : &caches,
+                        overrides.empty() ? nullptr : &overrides);
+    }
+    return encodeBuf;
+}
+
+/**
+ * In tolerant mode a row that cannot be encoded or routed goes to the dead-letter file
+ * and the stream carries on; otherwise the error aborts the table as before.
+ */
+void DBHelper::writeData(std::vector<Field> &result, const std::size_t rowBytes) {
+    std::size_t target = noShard;
+    try {
+        encodeRow(result);
+        if (streams.size() == 1) {
+            target = 0;
+        } else if (!partitions.empty()) {
+            target = partitionFor(encodeBuf);
+        } else if (shardCol != noShard) {
+            target = route(result);
+        }
+    } catch (const std::exception &e) {
+        if (!deadLetter) {
+            throw;
+        }
+        const auto *conv = dynamic_cast<const ConversionError *>(&e);
+        deadLetter->reject(toTable, keyOf(result), conv ? conv->column : "",
+                           conv ? conv->reason : e.what());
+        rejected++;
+        releaseRow(rowBytes);
+        return;
+    }
+    const std::vector<char> &data = encodeBuf;
+    rowsOut++;
+    bytesOut += data.size();
+    const std::string &key = keyOf(result);
+    if (target != noShard) {
+        queueRow(streams[target], data, key);
+    } else {
+        // Unsharded tables are replicated to every destination
+        for (CopyStream &stream : streams) {
+            queueRow(stream, data, key);
+        }
+    }
+    releaseRow(rowBytes);
+}
+
+/**
+ * The row's budget is only held while it is in flight, so buffers an oversized row
+ * grew past a send buffer's worth are given back rather than kept outside the budget.
+ */
+void DBHelper::releaseRow(const std::size_t rowBytes) {
+    lease.shrink(rowBytes);
+    if (rowBytes <= sendBufferSize) {
+        return;
+    }
+    rowBufferPeak = std::max(rowBufferPeak, rowBufferBytes());
+    for (Field &field : rowBuf) {
+        if (field.value.capacity() > sendBufferSize) {
+            std::string().swap(field.value);
+        }
+    }
+    if (encodeBuf.capacity() > sendBufferSize) {
+        std::vector<char>().swap(encodeBuf);
+    }
+    if (textScratch.capacity() > sendBufferSize) {
+        std::string().swap(textScratch);
+    }
+}
+
+void DBHelper::queueRow(CopyStream &stream, const std::vector<char> &data,
+                        const std::string &key) {
+    std::vector<char> &sendBuf = stream.sendBuf;
+    if (sendBuf.size() + data.size() > sendBuf.capacity()) {
+        flush(stream);
+    }
+    if (data.size() > sendBuf.capacity()) {
+        if (deadLetter) {
+            // A batch of its own, still replayable without growing the send buffer
+            const std::size_t end = data.size();
+            loadBatch(stream, data.data(), &end, &key, 0, 1);
+        } else {
+            sendData(stream.pg.get(), data.data(), data.size()); // Oversized row bypasses
+        }
+    } else {
+        sendBuf.insert(sendBuf.end(), data.begin(), data.end());
+        if (deadLetter) {
+            stream.rowEnds.push_back(sendBuf.size());
+            stream.rowKeys.push_back(key);
+        }
+    }
+}
 
-void DBHelper::writeData(const std::vector<Field> &result) {
-    const auto data = makeBinaryRow(result, mapping, converters);
-    if (PQputCopyData(pg.get(), data.data(), static_cast<int>(data.size())) <= 0) {
+void DBHelper::sendData(PGconn *pg, const char *data, const std::size_t size) {
+    TRACE_SPAN("send");
+    if (PQputCopyData(pg, data, static_cast<int>(size)) <= 0) {
         const std::string error =
-            std::string("COPY binary row write failed: ") + PQerrorMessage(pg.get());
+            std::string("COPY binary row write failed: ") + PQerrorMessage(pg);
         throw std::runtime_error(error);
     }
 }
 
+void DBHelper::flush(CopyStream &stream) {
+    if (stream.sendBuf.empty()) {
+        return;
+    }
+    if (deadLetter) {
+        loadBatch(stream, stream.sendBuf.data(), stream.rowEnds.data(),
+                  stream.rowKeys.data(), 0, stream.rowEnds.size());
+        stream.rowEnds.clear();
+        stream.rowKeys.clear();
+    } else {
+        sendData(stream.pg.get(), stream.sendBuf.data(), stream.sendBuf.size());
+    }
+    stream.sendBuf.clear();
+}
+
+/**
+ * COPY rows [first, last) of a batch, where row i ends at ends[i] bytes into data. A
+ * rejected batch is retried in halves until the offending rows are isolated, so one
+ * bad row costs about 2 log2(n) extra COPYs instead of the whole load.
+ */
+void DBHelper::loadBatch(CopyStream &stream, const char *data, const std::size_t *ends,
+                         const std::string *keys, const std::size_t first,
+                         const std::size_t last) {
+    TRACE_SPAN("copy batch");
+    const std::size_t begin = first == 0 ? 0 : ends[first - 1];
+    const std::string error = tryCopy(stream, data + begin, ends[last - 1] - begin);
+    if (error.empty()) {
+        return;
+    }
+    if (last - first == 1) {
+        deadLetter->reject(toTable, keys[first], "", error);
+        rejected++;
+        return;
+    }
+    const std::size_t mid = first + ((last - first) / 2);
+    loadBatch(stream, data, ends, keys, first, mid);
+    loadBatch(stream, data, ends, keys, mid, last);
+}
+
+/**
+ * One self-contained COPY of already-encoded rows. Returns the server's error if it
+ * rejected the data; failures to send or to reach the server throw. Incremental loads run
+ * inside the merge transaction, so each attempt gets a savepoint to roll back to.
+ */
+std::string DBHelper::tryCopy(CopyStream &stream, const char *data,
+                              const std::size_t size) {
+    PGconn *pg = stream.pg.get();
+    if (incremental) {
+        execPG(pg, "SAVEPOINT migrate_batch", "SAVEPOINT");
+    }
+    startCopy(pg, stream.table.empty() ? copyTarget : stream.table);
+    try {
+        sendData(pg, data, size);
+        endCopy(pg);
+    } catch (const CopyRejected &e) {
+        if (incremental) {
+            execPG(pg, "ROLLBACK TO SAVEPOINT migrate_batch", "ROLLBACK TO SAVEPOINT");
+        }
+        return e.what();
+    }
+    if (incremental) {
+        execPG(pg, "RELEASE SAVEPOINT migrate_batch", "RELEASE SAVEPOINT");
+    }
+    return "";
+}
+
 void DBHelper::writeMysqlRow(const MYSQL_ROW &row) {
     const std::uint32_t ncols = mysql_num_fields(res.get());
     if (mapping.size() != ncols) {
         throw std::runtime_error("We seem to have more columns than specified...");
     }
-    std::vector<Field> result;
-    result.reserve(ncols);
-    std::size_t col = 0;
-    for (const auto &m : mapping) {
-        result.emplace_back(m.first, row[col] ? row[col] : "");
-        col++;
+    const unsigned long *lengths = mysql_fetch_lengths(res.get());
+    std::size_t rawBytes = 0;
+    for (std::uint32_t i = 0; i < ncols; i++) {
+        rawBytes += lengths[i];
+    }
+    // Blocks here, before the next fetch, while the global budget is exhausted
+    const std::size_t rowBytes = reserveRow(rawBytes, ncols);
+    fillRow(row, lengths);
+    writeData(rowBuf, rowBytes);
+    pace(rawBytes);
+}
+
+// Charging in chunks keeps the shared lock off the per-row path
+void DBHelper::pace(const std::size_t rawBytes) {
+    paceRows++;
+    paceBytes += rawBytes;
+    if (throttle &&
+        (paceRows >= throttle->chargeRows() || paceBytes >= throttle->chargeBytes())) {
+        TRACE_SPAN("throttle");
+        throttle->take(paceRows, paceBytes);
+        paceRows = 0;
+        paceBytes = 0;
+    }
+}
+
+// assign keeps each field's capacity, so after the first rows no value allocates
+void DBHelper::fillRow(const MYSQL_ROW &row, const unsigned long *lengths) {
+    for (std::size_t col = 0; col < rowBuf.size(); col++) {
+        // Real lengths, so binary values with embedded NULs survive
+        if (row[col]) {
+            rowBuf[col].value.assign(row[col], lengths[col]);
+        } else {
+            rowBuf[col].value.clear();
+        }
     }
-    writeData(result);
 }
 
 void DBHelper::writeCSVRow(const csv::CSVRow &row) {
-    const std::size_t ncols = mapping.size();
-    std::vector<Field> result;
-    result.reserve(ncols);
-    for (const auto &m : mapping) {
-        const std::string &val = row[m.first].get<std::string>();
-        result.emplace_back(m.first, val);
+    std::size_t rawBytes = 0;
+    for (Field &field : rowBuf) {
+        const csv::string_view val = row[field.column].get_sv();
+        rawBytes += val.size();
+        field.value.assign(val.data(), val.size());
     }
-    writeData(result);
+    writeData(rowBuf, reserveRow(rawBytes, rowBuf.size()));
+    pace(rawBytes);
 }
 
 void DBHelper::endCopy() {
+    for (CopyStream &stream : streams) {
+        flush(stream);
+        if (!deadLetter) {
+            endCopy(stream.pg.get());
+        }
+    }
+}
+
+void DBHelper::endCopy(PGconn *pg) {
+    TRACE_SPAN("end copy");
     const auto trailer = makeBinaryTrailer();
-    if (PQputCopyData(pg.get(), trailer.data(), static_cast<int>(trailer.size())) <= 0) {
+    if (!textCopy &&
+        PQputCopyData(pg, trailer.data(), static_cast<int>(trailer.size())) <= 0) {
         const std::string error =
-            std::string("PQputCopyData trailer failed: ") + PQerrorMessage(pg.get());
+            std::string("PQputCopyData trailer failed: ") + PQerrorMessage(pg);
         throw std::runtime_error(error);
     }
-    if (PQputCopyEnd(pg.get(), nullptr) <= 0) {
+    if (PQputCopyEnd(pg, nullptr) <= 0) {
         const std::string error =
-            std::string("PQputCopyEnd failed: ") + PQerrorMessage(pg.get());
+            std::string("PQputCopyEnd failed: ") + PQerrorMessage(pg);
         throw std::runtime_error(error);
     }
-    while (PGresult *r = PQgetResult(pg.get())) {
-        if (PQresultStatus(r) != PGRES_COMMAND_OK) {
-            const std::string error =
-                "COPY finish failed: " + std::string(PQerrorMessage(pg.get()));
-            PQclear(r);
-            throw std::runtime_error(error);
+    // Drained to the end before throwing, so the connection is idle for the next COPY
+    std::string error;
+    bool rejectedData = false;
+    while (PGresult *r = PQgetResult(pg)) {
+        const ExecStatusType status = PQresultStatus(r);
+        if (status != PGRES_COMMAND_OK && error.empty()) {
+            error = "COPY finish failed: " + std::string(PQresultErrorMessage(r));
+            rejectedData = status == PGRES_FATAL_ERROR;
         }
         PQclear(r);
     }
+    if (error.empty()) {
+        return;
+    }
+    if (rejectedData && PQstatus(pg) == CONNECTION_OK) {
+        throw CopyRejected(error);
+    }
+    throw std::runtime_error(error);
 }
 
+// Introspected tables bring their own DDL; hand-written ones must already exist
 void DBHelper::createTable() {
-    // Todo: query mysql and get CREATE TABLE statement (or use config?)
-    const std::string schema;
-    PGresult *r = PQexec(pg.get(), schema.c_str());
+    TRACE_SPAN("create table");
+    for (const std::string &sql : ddl) {
+        execPG(sql, "CREATE TABLE");
+    }
+}
+
+void DBHelper::disableTriggers() {
+    TRACE_SPAN("disable triggers");
+    const std::string sql = "ALTER TABLE " + toIdent + " DISABLE TRIGGER ALL";
+    for (CopyStream &stream : streams) {
+        if (!stream.primary) {
+            continue;
+        }
+        PGresult *r = PQexec(stream.pg.get(), sql.c_str());
+        PQclear(r);
+    }
+}
+
+void DBHelper::enableTriggers() {
+    TRACE_SPAN("enable triggers");
+    const std::string sql = "ALTER TABLE " + toIdent + " ENABLE TRIGGER ALL";
+    for (CopyStream &stream : streams) {
+        if (!stream.primary) {
+            continue;
+        }
+        PGresult *r = PQexec(stream.pg.get(), sql.c_str());
+        PQclear(r);
+    }
+}
+
+// Runs once on every destination
+void DBHelper::execPG(const std::string &sql, const std::string &what) {
+    for (CopyStream &stream : streams) {
+        if (stream.primary) {
+            execPG(stream.pg.get(), sql, what);
+        }
+    }
+}
+
+void DBHelper::execPG(PGconn *pg, const std::string &sql, const std::string &what) {
+    PGresult *r = PQexec(pg, sql.c_str());
     if (PQresultStatus(r) != PGRES_COMMAND_OK) {
-        std::string error =
-            "CREATE TABLE failed: " + std::string(PQerrorMessage(pg.get()));
+        const std::string error = what + " failed: " + PQerrorMessage(pg);
         PQclear(r);
         throw std::runtime_error(error);
     }
     PQclear(r);
 }
 
-void DBHelper::disableTriggers() {
-    const std::string sql = "ALTER TABLE " + toTable + " DISABLE TRIGGER ALL";
-    PGresult *r = PQexec(pg.get(), sql.c_str());
-    PQclear(r);
+std::string DBHelper::queryHighWater() {
+    const std::string sql =
+        "SELECT MAX(" + quoteSourceIdent(watermarkCol) + ") FROM " + fromIdent;
+    if (mysql_query(mysql.get(), sql.c_str())) {
+        std::string error =
+            std::string("MySQL watermark query failed: ") + mysql_error(mysql.get());
+        throw std::runtime_error(error);
+    }
+    const MysqlResPtr r(mysql_store_result(mysql.get()));
+    if (!r) {
+        throw std::runtime_error("mysql_store_result failed");
+    }
+    const MYSQL_ROW row = mysql_fetch_row(r.get());
+    return (row && row[0]) ? row[0] : "";
 }
 
-void DBHelper::enableTriggers() {
-    const std::string sql = "ALTER TABLE " + toTable + " ENABLE TRIGGER ALL";
-    PGresult *r = PQexec(pg.get(), sql.c_str());
-    PQclear(r);
+/**
+ * Cut the key's span into a few chunks per replica, so a replica that reads faster ends
+ * up taking more of them. Widths are even in key values rather than rows: sparse or
+ * skewed keys only make some chunks cheaper, which the load balancing absorbs.
+ */
+std::vector<KeyRange> DBHelper::splitKeys() {
+    static constexpr std::uint64_t chunksPerReplica = 4;
+    std::string sql = "SELECT MIN(" + sourceKey() + "), MAX(" + sourceKey() + ") FROM " +
+                      fromIdent;
+    if (!where.empty()) {
+        sql += " WHERE (" + where + ")";
+    }
+    if (mysql_query(mysql.get(), sql.c_str())) {
+        std::string error =
+            std::string("MySQL key range query failed: ") + mysql_error(mysql.get());
+        throw std::runtime_error(error);
+    }
+    const MysqlResPtr r(mysql_store_result(mysql.get()));
+    const MYSQL_ROW row = r ? mysql_fetch_row(r.get()) : nullptr;
+    if (!row || !row[0] || !row[1]) {
+        return {};
+    }
+    const std::int64_t low = std::stoll(row[0]);
+    const std::int64_t high = std::stoll(row[1]);
+    // Unsigned, as the span of a full int64 range does not fit in a signed one
+    const std::uint64_t span =
+        static_cast<std::uint64_t>(high) - static_cast<std::uint64_t>(low);
+    const std::uint64_t step = span / (replicas->size() * chunksPerReplica) + 1;
+    const auto base = static_cast<std::uint64_t>(low);
+    std::vector<KeyRange> ranges;
+    for (std::uint64_t at = 0;; at += step) {
+        const std::uint64_t last = span - at < step ? span : at + step - 1;
+        ranges.push_back({static_cast<std::int64_t>(base + at),
+                          static_cast<std::int64_t>(base + last), ranges.empty()});
+        if (last == span) {
+            return ranges;
+        }
+    }
 }
 
-void DBHelper::migrateTable() {
-    // createTable();
-    disableTriggers();
-    startCopy();
+// InnoDB's running estimate: free to read, where a COUNT(*) would scan the table
+std::uint64_t DBHelper::estimateRows() {
+    std::string escaped(fromTable.size() * 2 + 1, '\0');
+    escaped.resize(mysql_real_escape_string(mysql.get(), escaped.data(),
+                                            fromTable.c_str(), fromTable.size()));
+    const std::string sql = "SELECT TABLE_ROWS FROM information_schema.TABLES "
+                            "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = '" +
+                            escaped + "'";
+    if (mysql_query(mysql.get(), sql.c_str())) {
+        std::string error =
+            std::string("MySQL row estimate failed: ") + mysql_error(mysql.get());
+        throw std::runtime_error(error);
+    }
+    const MysqlResPtr r(mysql_store_result(mysql.get()));
+    const MYSQL_ROW row = r ? mysql_fetch_row(r.get()) : nullptr;
+    return (row && row[0]) ? std::stoull(row[0]) : 0;
+}
+
+// Shards commit independently, so resume from the oldest of their watermarks
+void DBHelper::loadWatermark() {
+    std::call_once(watermarkOnce, [this]() { execPG(watermarkDDL, "Watermark setup"); });
+    const char *params[1] = {toTable.c_str()};
+    for (std::size_t i = 0; i < streams.size(); i++) {
+        if (!streams[i].primary) {
+            continue;
+        }
+        PGconn *pg = streams[i].pg.get();
+        PGresult *r = PQexecParams(pg,
+                                   "SELECT high_water FROM migrate_watermarks "
+                                   "WHERE table_name = $1",
+                                   1, nullptr, params, nullptr, nullptr, 0);
+        if (PQresultStatus(r) != PGRES_TUPLES_OK) {
+            const std::string error =
+                std::string("Watermark lookup failed: ") + PQerrorMessage(pg);
+            PQclear(r);
+            throw std::runtime_error(error);
+        }
+        if (PQntuples(r) == 0) {
+            PQclear(r);
+            throw std::runtime_error("No watermark recorded for " + toTable +
+                                     ", run a full load first");
+        }
+        const std::string mark = PQgetvalue(r, 0, 0);
+        if (i == 0 || mark < lowWater) {
+            lowWater = mark;
+        }
+        PQclear(r);
+    }
+}
+
+void DBHelper::saveWatermark() {
+    if (highWater.empty()) {
+        return; // Empty source table, nothing to anchor the next delta on
+    }
+    std::call_once(watermarkOnce, [this]() { execPG(watermarkDDL, "Watermark setup"); });
+    const char *params[2] = {toTable.c_str(), highWater.c_str()};
+    const char *upsert = "INSERT INTO migrate_watermarks (table_name, high_water) "
+                         "VALUES ($1, $2) ON CONFLICT (table_name) DO UPDATE SET "
+                         "high_water = EXCLUDED.high_water, recorded_at = now()";
+    for (CopyStream &stream : streams) {
+        if (!stream.primary) {
+            continue;
+        }
+        PGconn *pg = stream.pg.get();
+        PGresult *r = PQexecParams(pg, upsert, 2, nullptr, params, nullptr, nullptr, 0);
+        if (PQresultStatus(r) != PGRES_COMMAND_OK) {
+            const std::string error =
+                std::string("Watermark save failed: ") + PQerrorMessage(pg);
+            PQclear(r);
+            throw std::runtime_error(error);
+        }
+        PQclear(r);
+    }
+}
+
+void DBHelper::createStaging() {
+    const std::string sql = "CREATE TEMP TABLE " + stagingIdent + " (LIKE " + toIdent +
+                            " INCLUDING DEFAULTS) ON COMMIT DROP";
+    execPG(sql, "CREATE staging table");
+}
+
+/**
+ * Upsert the staged delta. Deletes on the source are not visible to a watermark and
+ * must be reconciled separately.
+ */
+void DBHelper::mergeStaging() {
+    TRACE_SPAN("merge");
+    const std::string cols = columnList();
+    std::string updates;
+    for (const auto &m : mapping) {
+        if (m.first == keyCol) {
+            continue;
+        }
+        if (!updates.empty())
+            updates += ", ";
+        updates += quoteIdent(m.first) + " = EXCLUDED." + quoteIdent(m.first);
+    }
+    const std::string sql =
+        "INSERT INTO " + toIdent + " (" + cols + ") OVERRIDING SYSTEM VALUE SELECT " +
+        cols + " FROM " + stagingIdent + " ON CONFLICT (" + quoteIdent(keyCol) + ") DO " +
+        (updates.empty() ? "NOTHING" : "UPDATE SET " + updates);
+    execPG(sql, "MERGE delta");
+}
+
+void DBHelper::copyRows() {
     if (!useCSV) {
         MYSQL_ROW row;
         while ((row = getMysqlRow())) {
             writeMysqlRow(row);
         }
+        res.reset();
     } else {
         csv::CSVReader reader(fromTable + ".csv");
         for (const csv::CSVRow &row : reader) {
             writeCSVRow(row);
         }
     }
-    endCopy();
+    if (throttle && paceRows > 0) {
+        throttle->take(paceRows, paceBytes);
+        paceRows = 0;
+        paceBytes = 0;
+    }
+}
+
+/**
+ * Read the chunks with one reader per replica, each taking the next chunk as it frees
+ * up. Every chunk is its own COPY, so unlike a single COPY a failure would leave the
+ * chunks before it loaded: a table that started out empty is truncated back to empty,
+ * and one that did not is reported as partly loaded.
+ */
+void DBHelper::copyChunks() {
+    bool wasEmpty = true;
+    for (CopyStream &stream : streams) {
+        if (!stream.primary) {
+            continue;
+        }
+        PGconn *pg = stream.pg.get();
+        const std::string sql = "SELECT EXISTS (SELECT 1 FROM " + toIdent + ")";
+        PGresult *r = PQexec(pg, sql.c_str());
+        if (PQresultStatus(r) != PGRES_TUPLES_OK) {
+            const std::string error =
+                toTable + ": emptiness check failed: " + PQerrorMessage(pg);
+            PQclear(r);
+            throw std::runtime_error(error);
+        }
+        wasEmpty = wasEmpty && PQgetvalue(r, 0, 0)[0] == 'f';
+        PQclear(r);
+    }
+    try {
+        readChunks();
+    } catch (const std::exception &e) {
+        if (!wasEmpty) {
+            throw std::runtime_error(toTable +
+                                     ": chunked load failed, leaving the table partly "
+                                     "loaded: " +
+                                     e.what());
+        }
+        execPG("TRUNCATE " + toIdent, "TRUNCATE after failed chunks");
+        throw;
+    }
+}
+
+void DBHelper::readChunks() {
+    std::mutex m;
+    std::size_t next = 0;
+    std::exception_ptr error;
+    std::vector<std::thread> readers;
+    const std::size_t count = std::min(chunks.size(), replicas->size());
+    readers.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        readers.emplace_back([this, &m, &next, &error]() {
+            for (;;) {
+                std::size_t at = 0;
+                {
+                    const std::lock_guard<std::mutex> lock(m);
+                    if (error || next >= chunks.size()) {
+                        return;
+                    }
+                    at = next++;
+                }
+                try {
+                    DBHelper chunk(tableConf, runConfig, myConfig, pgConfigs[0],
+                                   chunks[at]);
+                    chunk.migrateTable();
+                    const std::lock_guard<std::mutex> lock(m);
+                    rowsOut += chunk.rowsOut;
+                    bytesOut += chunk.bytesOut;
+                    rejected += chunk.rejected;
+                } catch (...) {
+                    const std::lock_guard<std::mutex> lock(m);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    return;
+                }
+            }
+        });
+    }
+    for (std::thread &t : readers) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void DBHelper::migrateTable() {
+    if (range) {
+        // The table's own helper created it and handles its triggers and watermark
+        startCopy(toIdent);
+        copyRows();
+        endCopy();
+        return;
+    }
+    createTable();
+    disableTriggers();
+    if (truncateFirst && !incremental) {
+        // Merges are idempotent, but appending again would duplicate what did load
+        execPG("TRUNCATE " + toIdent, "TRUNCATE");
+    }
+    if (incremental) {
+        // Staging, merge and the new watermark commit or roll back together
+        execPG("BEGIN", "BEGIN");
+        createStaging();
+        startCopy(stagingIdent);
+        copyRows();
+        endCopy();
+        mergeStaging();
+        saveWatermark();
+        execPG("COMMIT", "COMMIT");
+    } else if (!chunks.empty()) {
+        copyChunks();
+        saveWatermark();
+    } else {
+        startCopy(toIdent);
+        copyRows();
+        endCopy();
+        saveWatermark();
+    }
     enableTriggers();
+    if (rejected > 0) {
+        std::cout << toTable << ": " << rejected << " rows dead-lettered" << std::endl;
+    }
+    std::cout << toTable << ": row buffers peaked at "
+              << (std::max(rowBufferPeak, rowBufferBytes()) >> 10) << " KiB"
+              << std::endl;
+    reportCaches();
     // Todo: recreate foreign key constraints
 }
+
+static double secondsSince(const std::chrono::steady_clock::time_point start) {
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+/**
+ * Dry-run probe over the sampled rows: fetch them, encode them and COPY them into a
+ * temporary copy of the destination table, timing each stage on its own so the planner
+ * can tell which side bounds the table. The real table is never written.
+ */
+TableProfile DBHelper::profile() {
+    if (useCSV) {
+        throw std::runtime_error("Dry runs need a MariaDB source");
+    }
+    TableProfile p;
+    p.table = toTable;
+    std::vector<std::vector<Field>> sample;
+    sample.reserve(sampleRows);
+    auto start = std::chrono::steady_clock::now();
+    MYSQL_ROW row;
+    while ((row = getMysqlRow())) {
+        fillRow(row, mysql_fetch_lengths(res.get()));
+        sample.push_back(rowBuf);
+    }
+    res.reset();
+    p.fetchSecs = secondsSince(start);
+    p.sampled = sample.size();
+    p.rows = estimateRows();
+
+    std::vector<char> encoded;
+    start = std::chrono::steady_clock::now();
+    for (auto &fields : sample) {
+        const std::vector<char> &data = encodeRow(fields);
+        encoded.insert(encoded.end(), data.begin(), data.end());
+    }
+    p.encodeSecs = secondsSince(start);
+    p.bytes = encoded.size();
+
+    /**
+     * The probe is shaped LIKE the table, so an introspected one is created first; all
+     * of it, types and table included, is rolled back so the destination is unchanged.
+     */
+    PGconn *pg = streams[0].pg.get();
+    const std::string probe = quoteIdent("migrate_probe_" + toTable);
+    execPG("BEGIN", "BEGIN");
+    try {
+        createTable();
+        execPG(pg, "CREATE TEMP TABLE " + probe + " (LIKE " + toIdent + ")",
+               "CREATE probe table");
+        start = std::chrono::steady_clock::now();
+        startCopy(pg, probe);
+        for (std::size_t at = 0; at < encoded.size(); at += sendBufferSize) {
+            sendData(pg, encoded.data() + at,
+                     std::min(sendBufferSize, encoded.size() - at));
+        }
+        endCopy(pg);
+        p.copySecs = secondsSince(start);
+    } catch (...) {
+        // Best effort: the original error is the one worth reporting
+        for (CopyStream &stream : streams) {
+            if (stream.primary) {
+                PQclear(PQexec(stream.pg.get(), "ROLLBACK"));
+            }
+        }
+        throw;
+    }
+    execPG("ROLLBACK", "ROLLBACK");
+    return p;
+}
+
+// What the reused row buffers hold now; only an oversized row makes them shrink again
+std::size_t DBHelper::rowBufferBytes() const {
+    std::size_t bytes = encodeBuf.capacity() + (rowBuf.capacity() * sizeof(Field));
+    for (const Field &field : rowBuf) {
+        bytes += field.value.capacity();
+    }
+    return bytes;
+}
+
+std::uint64_t DBHelper::rowsWritten() const { return rowsOut; }
+
+std::uint64_t DBHelper::bytesWritten() const { return bytesOut; }
+
+void DBHelper::reportCaches() const {
+    if (caches.empty()) {
+        return;
+    }
+    std::ostringstream report;
+    std::size_t col = 0;
+    for (const auto &m : mapping) {
+        const ConvertCache &cache = caches[col++];
+        if (cache.hits() + cache.misses() == 0) {
+            continue;
+        }
+        report << "  " << toTable << "." << m.first << " cache: " << cache.hits()
+               << " hits, " << cache.misses() << " misses"
+               << (cache.enabled() ? "" : " (disabled)") << "\n";
+    }
+    std::cout << report.str() << std::flush;
+}
@@ -0,0 +1,29 @@
+#include "dead_letter.hpp"
+#include "text.hpp"
+#include <stdexcept>
+#include <vector>
+
+DeadLetter::DeadLetter(const std::string &path) : out(path, std::ios::app) {
+    if (!out) {
+        throw std::runtime_error("Cannot open dead-letter file: " + path);
+    }
+}
+
+void DeadLetter::reject(const std::string &table, const std::string &key,
+                        const std::string &column, const std::string &reason) {
+    const std::vector<Field> row = {{"table_name", table},
+                                    {"row_key", key},
+                                    {"column_name", column},
+                                    {"reason", reason}};
+    const std::vector<char> line = makeTextRow(row);
+    const std::lock_guard<std::mutex> lock(m);
+    // Flushed per row: rejects are rare and must survive a later abort
+    out.write(line.data(), static_cast<std::streamsize>(line.size()));
+    out.flush();
+    rows++;
+}
+
+std::size_t DeadLetter::count() {
+    const std::lock_guard<std::mutex> lock(m);
+    return rows;
+}
@@ -1,11 +1,24 @@
+#include "affinity.hpp"
+#include "control.hpp"
 #include "db_helper.hpp"
+#include "dead_letter.hpp"
 #include "io_helper.hpp"
+#include "maintenance.hpp"
+#include "memory_budget.hpp"
+#include "process_pool.hpp"
+#include "replicas.hpp"
+#include "schema.hpp"
+#include "snapshot.hpp"
+#include "throttle.hpp"
+#include "trace.hpp"
 #include "types.hpp"
 #include <CLI/CLI.hpp>
-#include <array>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <exception>
 #include <iostream>
+#include <limits>
 #include <thread>
 
 struct ThreadJoiner {
@@ -19,15 +32,40 @@ struct ThreadJoiner {
     }
 };
 
-void migrateTable(const TableConf *conf, const bool useCSV, const MysqlConfig &myConfig,
-                  const PgsqlConfig &pgConfig) {
+// Split host:port, false if either part is missing or the port is not a number
+static bool parseAddress(const std::string &addr, std::string &host,
+                         std::uint32_t &port) {
+    const std::size_t colon = addr.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        return false;
+    }
+    try {
+        port = static_cast<std::uint32_t>(std::stoul(addr.substr(colon + 1)));
+    } catch (const std::exception &) {
+        return false;
+    }
+    host = addr.substr(0, colon);
+    return true;
+}
+
+void migrateTable(const TableConf *conf, const RunConfig &runConfig,
+                  const MysqlConfig &myConfig, const PgsqlConfig &pgConfig,
+                  NodeStats *stats) {
+    const auto start = std::chrono::steady_clock::now();
     const std::unique_ptr<DBHelper> dbHelper =
-        std::make_unique<DBHelper>(conf, useCSV, myConfig, pgConfig);
+        std::make_unique<DBHelper>(conf, runConfig, myConfig, pgConfig);
     std::cout << "Migrating table: " << conf->tabName << std::endl;
     dbHelper->migrateTable();
+    if (stats) {
+        const auto busy = std::chrono::steady_clock::now() - start;
+        stats->rows += dbHelper->rowsWritten();
+        stats->bytes += dbHelper->bytesWritten();
+        stats->busyNanos += static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count());
+    }
 }
 
-int main() {
+int main(int argc, char **argv) {
     /**
      * --- Add tables to migrate and their mappings below ---
      */
@@ -53,19 +91,171 @@ int main() {
                                {"created_at", PgType::TIMESTAMPTZ},
                                {"updated_at", PgType::TIMESTAMPTZ}}};
 
-    const std::array<const TableConf *, 3> maps = {&userMap, &siteMap, &jobMap};
+    std::vector<const TableConf *> maps = {&userMap, &siteMap, &jobMap};
 
     /**
      * --- You can ignore everything after this line ---
      */
 
-    /**
-     * Todo: Use CLI 11 to parse arguments:
-     * --csv to read from a csv file per table (add .csv to the map name above).
-     */
+    CLI::App app{"Migrate MariaDB tables to PostgreSQL"};
+    RunConfig runConfig;
+    app.add_flag("--csv", runConfig.useCSV,
+                 "Read each table from <table>.csv instead of MariaDB");
+    app.add_flag("--incremental", runConfig.incremental,
+                 "Copy only rows changed since the last recorded watermark and merge "
+                 "them into the destination");
+    app.add_flag("--convert-cache", runConfig.convertCache,
+                 "Memoise conversions of repeated values per column");
+    app.add_option("--source-tz", runConfig.sourceZone,
+                   "Zoneinfo name for offset-less source timestamps, e.g. Europe/London");
+    std::vector<std::string> shardAddrs;
+    app.add_option("--shard", shardAddrs,
+                   "Destination shard as host:port, repeat per shard. Uses the "
+                   "PostgreSQL database and credentials");
+    app.add_option("--partition-streams", runConfig.maxPartitionStreams,
+                   "Most partitions of one table to COPY into directly, 0 to always "
+                   "copy via the parent");
+    const std::map<std::string, CopyFormat> formats = {
+        {"binary", CopyFormat::BINARY},
+        {"text", CopyFormat::TEXT},
+        {"auto", CopyFormat::AUTO}};
+    app.add_option("--copy-format", runConfig.format,
+                   "COPY format for tables without their own: binary, text or auto. "
+                   "auto is text unless a column needs binary (bytea, arrays, "
+                   "--source-tz, partitions); text skips --convert-cache, and a bad "
+                   "value is only dead-lettered once the server rejects its batch")
+        ->transform(CLI::CheckedTransformer(formats, CLI::ignore_case));
+    app.add_option("--source-charset", runConfig.sourceCharset,
+                   "Stored encoding of source text columns without their own: utf8, "
+                   "latin1 (cp1252) or iso-8859-1; other than utf8, columns are read "
+                   "untranscoded and decoded here");
+    const std::map<std::string, InvalidText> textPolicies = {
+        {"reject", InvalidText::REJECT},
+        {"replace", InvalidText::REPLACE},
+        {"strip", InvalidText::STRIP}};
+    app.add_option("--invalid-text", runConfig.invalidText,
+                   "Text that is not valid UTF-8: reject the row, replace bad bytes "
+                   "with U+FFFD or strip them")
+        ->transform(CLI::CheckedTransformer(textPolicies, CLI::ignore_case));
+    std::vector<std::string> replicaAddrs;
+    app.add_option("--replica", replicaAddrs,
+                   "Source replica as host:port, repeat per replica. Reads spread over "
+                   "the replicas by load, chunking tables on integer keys; uses the "
+                   "MariaDB database and credentials");
+    double replicaLagSecs = 60;
+    app.add_option("--replica-lag-timeout", replicaLagSecs,
+                   "Seconds to wait for the replicas to reach the source's GTID "
+                   "position before reading");
+    bool useSnapshot = false;
+    app.add_flag("--snapshot", useSnapshot,
+                 "Read every table from one consistent point in time");
+    std::string deadLetterPath;
+    app.add_option("--dead-letter", deadLetterPath,
+                   "Tolerate bad rows: append them to this file instead of aborting, "
+                   "retrying rejected batches in halves to isolate them. With "
+                   "--processes, a retried table's failed attempts leave their rejects "
+                   "in the file too");
+#ifdef MIGRATE_TRACE
+    std::string tracePath = "trace.json";
+    app.add_option("--trace", tracePath, "Where to write the Chrome trace-event JSON");
+#endif
+    std::size_t memoryBudgetMB = 0;
+    app.add_option("--memory-budget-mb", memoryBudgetMB,
+                   "Cap on bytes buffered across all workers, 0 for unlimited");
+    std::uint32_t threadCount = 0;
+    app.add_option("--threads", threadCount, "Worker threads, 0 for one per core");
+    std::size_t sendBufferKB = runConfig.sendBufferSize >> 10;
+    app.add_option("--send-buffer-kb", sendBufferKB,
+                   "Rows batched per COPY write on each destination stream");
+    bool dryRun = false;
+    app.add_flag("--dry-run", dryRun,
+                 "Sample every table, time fetch, encode and COPY, and suggest "
+                 "--threads and --send-buffer-kb without loading anything");
+    std::string cpuList;
+    app.add_option("--cpus", cpuList,
+                   "Pin workers to these CPUs, e.g. 0-7,16-23; one CPU per worker in "
+                   "turn unless --numa is set");
+    bool perNode = false;
+    app.add_flag("--numa", perNode,
+                 "Spread workers over NUMA nodes, each on its node's CPUs and memory");
+    std::size_t sampleRows = 50000;
+    app.add_option("--sample-rows", sampleRows, "Rows per table sampled by --dry-run");
+    bool useSchema = false;
+    app.add_flag("--introspect", useSchema,
+                 "Derive every table's mapping and DDL from the source schema instead "
+                 "of the built-in list; constraints are added once all are loaded");
+    bool tinyintBool = false;
+    app.add_flag("--tinyint1-as-bool", tinyintBool,
+                 "With --introspect, map tinyint(1) to boolean rather than smallint; "
+                 "fails on values other than 0 and 1");
+    std::vector<std::string> onlyTables;
+    app.add_option("--tables", onlyTables, "With --introspect, only these tables")
+        ->delimiter(',');
+    std::size_t postLoadWorkers = 1;
+    app.add_option("--post-load-workers", postLoadWorkers,
+                   "Connections that reset sequences and ANALYZE each table as soon as "
+                   "it loads, 0 to skip");
+    bool vacuumFreeze = false;
+    app.add_flag("--vacuum-freeze", vacuumFreeze,
+                 "Post-load, VACUUM (FREEZE, ANALYZE) instead of ANALYZE");
+    double maxRowsPerSec = 0;
+    app.add_option("--max-rows-per-sec", maxRowsPerSec,
+                   "Cap on source rows fetched per second by all workers, 0 for none");
+    double maxMBPerSec = 0;
+    app.add_option("--max-mb-per-sec", maxMBPerSec,
+                   "Cap on source MiB fetched per second by all workers, 0 for none; "
+                   "keep it above the largest row divided by the server's "
+                   "net_write_timeout");
+    std::string controlPath;
+    app.add_option("--control", controlPath,
+                   "UNIX socket for live stats and for changing limits and workers "
+                   "while running; send it 'help' for the commands");
+    std::size_t processCount = 0;
+    app.add_option("--processes", processCount,
+                   "Migrate tables in this many worker processes instead of threads, "
+                   "so a crashed worker costs only its table, which is retried");
+    unsigned taskRetries = 2;
+    app.add_option("--task-retries", taskRetries,
+                   "With --processes, times a failed table is retried. Unless "
+                   "incremental, a retry first TRUNCATEs the whole destination table, "
+                   "rows it held before this run included; use 0 when appending to "
+                   "tables that already hold data");
+    std::vector<int> workerFds;
+    app.add_option("--worker-fds", workerFds)->delimiter(',')->expected(2)->group("");
+    bool printDDL = false;
+    app.add_flag("--print-ddl", printDDL,
+                 "With --introspect, print the generated DDL and exit");
+    CLI11_PARSE(app, argc, argv);
 
-    const bool useCSV = false;
-    const std::uint32_t max_threads = std::thread::hardware_concurrency();
+    const bool isWorker = !workerFds.empty();
+    if (processCount > 0 && (useSnapshot || !controlPath.empty() || !cpuList.empty() ||
+                             perNode || !replicaAddrs.empty())) {
+        // Each of these is state one process holds for all workers; for replicas, the
+        // open-read counts that spread the load
+        std::cerr << "--processes cannot be combined with --snapshot, --control, --cpus, "
+                     "--numa or --replica"
+                  << std::endl;
+        return 1;
+    }
+    // A worker process migrates one table at a time and gets its share of the limits
+    const std::uint32_t max_threads =
+        isWorker         ? 1
+        : threadCount > 0 ? threadCount
+                         : std::max(1U, std::thread::hardware_concurrency());
+    if (isWorker && processCount > 0) {
+        memoryBudgetMB /= processCount;
+        maxRowsPerSec /= static_cast<double>(processCount);
+        maxMBPerSec /= static_cast<double>(processCount);
+    }
+    runConfig.sendBufferSize = std::max<std::size_t>(sendBufferKB, 1) << 10;
+    MemoryBudget budget(memoryBudgetMB > 0 ? memoryBudgetMB << 20
+                                           : std::numeric_limits<std::size_t>::max());
+    runConfig.budget = &budget;
+    if (memoryBudgetMB > 0) {
+        // Keep every worker's send buffers within half the budget, leaving room for rows
+        runConfig.sendBudget =
+            budget.limit() / (2 * std::max<std::size_t>(max_threads, 1));
+    }
     std::vector<std::thread> threads;
     threads.reserve(max_threads);
     std::atomic<std::size_t> next{0};
@@ -73,32 +263,322 @@ int main() {
     std::atomic<bool> stop = {false};
     MysqlConfig myConfig;
     PgsqlConfig pgConfig;
-    getConfig(myConfig, pgConfig, useCSV);
+    getConfig(myConfig, pgConfig, runConfig.useCSV);
+    for (const std::string &addr : shardAddrs) {
+        PgsqlConfig shard = pgConfig;
+        if (!parseAddress(addr, shard.pghost, shard.pgport)) {
+            std::cerr << "Invalid shard address, expected host:port: " << addr
+                      << std::endl;
+            return 1;
+        }
+        runConfig.shards.push_back(shard);
+    }
+    std::vector<MysqlConfig> replicaConfigs;
+    for (const std::string &addr : replicaAddrs) {
+        MysqlConfig replica = myConfig;
+        if (!parseAddress(addr, replica.myhost, replica.myport)) {
+            std::cerr << "Invalid replica address, expected host:port: " << addr
+                      << std::endl;
+            return 1;
+        }
+        replicaConfigs.push_back(replica);
+    }
+    if (!replicaConfigs.empty() && (useSnapshot || runConfig.useCSV)) {
+        // A snapshot is one server's point in time, which no set of replicas can share
+        std::cerr << "--replica cannot be combined with --snapshot or --csv" << std::endl;
+        return 1;
+    }
+
+    std::vector<TableSchema> schemas;
+    if (useSchema) {
+        try {
+            const MysqlPtr mysql = connectMysql(myConfig);
+            schemas = introspect(mysql.get(), onlyTables, tinyintBool);
+        } catch (const std::exception &e) {
+            std::cerr << "Error reading source schema: " << e.what() << std::endl;
+            return 1;
+        }
+        maps.clear();
+        for (const TableSchema &schema : schemas) {
+            maps.push_back(&schema.conf);
+        }
+    }
+    if (printDDL && !isWorker) {
+        for (const TableSchema &schema : schemas) {
+            for (const std::string &sql : schema.conf.ddl) {
+                std::cout << sql << ";" << std::endl;
+            }
+        }
+        for (const TableSchema &schema : schemas) {
+            for (const std::string &sql : schema.constraints) {
+                std::cout << sql << ";" << std::endl;
+            }
+        }
+        return 0;
+    }
+
+    if (dryRun && !isWorker) {
+        // Probe tables one at a time so they do not skew each other's timings
+        RunConfig probeConfig = runConfig;
+        probeConfig.incremental = false;
+        probeConfig.sampleRows = std::max<std::size_t>(sampleRows, 1);
+        std::vector<TableProfile> profiles;
+        try {
+            for (const TableConf *conf : maps) {
+                DBHelper dbHelper(conf, probeConfig, myConfig, pgConfig);
+                profiles.push_back(dbHelper.profile());
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Error during dry run: " << e.what() << std::endl;
+            return 1;
+        }
+        printPlan(profiles, planRun(profiles, max_threads));
+        return 0;
+    }
+
+    std::unique_ptr<DeadLetter> deadLetter;
+    if (!deadLetterPath.empty()) {
+        try {
+            deadLetter = std::make_unique<DeadLetter>(deadLetterPath);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        runConfig.deadLetter = deadLetter.get();
+    }
 
-    {
+    std::vector<Placement> placements;
+    std::vector<NodeStats> nodeStats;
+    if (!cpuList.empty() || perNode) {
+        try {
+            placements = planPlacement(cpuList, perNode, max_threads);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        nodeStats = std::vector<NodeStats>(static_cast<std::size_t>(nodeCount()));
+    }
+
+    std::unique_ptr<SnapshotPool> snapshot;
+    if (useSnapshot && !runConfig.useCSV) {
+        try {
+            // One reader per concurrently migrating table, all opened under one lock
+            snapshot = std::make_unique<SnapshotPool>(
+                myConfig, std::min<std::size_t>(max_threads, maps.size()));
+        } catch (const std::exception &e) {
+            std::cerr << "Error taking snapshot: " << e.what() << std::endl;
+            return 1;
+        }
+        runConfig.snapshotPool = snapshot.get();
+        std::cout << "Consistent snapshot at GTID: "
+                  << (snapshot->position().empty() ? "(binlog disabled)"
+                                                   : snapshot->position())
+                  << std::endl;
+    }
+
+    std::unique_ptr<ReplicaSet> replicaSet;
+    if (!replicaConfigs.empty()) {
+        try {
+            replicaSet = std::make_unique<ReplicaSet>(std::move(replicaConfigs));
+            if (!isWorker) {
+                // Checked once by the coordinator, before any worker reads
+                const std::string gtid = primaryPosition(myConfig);
+                replicaSet->waitFor(gtid, replicaLagSecs);
+                std::cout << replicaSet->size() << " replicas caught up to GTID " << gtid
+                          << std::endl;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Error checking replicas: " << e.what() << std::endl;
+            return 1;
+        }
+        runConfig.replicas = replicaSet.get();
+    }
+
+    Throttle throttle;
+    throttle.setLimits(maxRowsPerSec, maxMBPerSec * 1024 * 1024);
+    runConfig.throttle = &throttle;
+
+    if (isWorker) {
+        return serveTasks(workerFds[0], workerFds[1],
+                          [&](const std::string &table, const unsigned attempt) {
+                              const auto conf = std::find_if(
+                                  maps.begin(), maps.end(), [&](const TableConf *c) {
+                                      return c->tabName == table;
+                                  });
+                              if (conf == maps.end()) {
+                                  // Its schema changed since the coordinator read it
+                                  throw std::runtime_error("Worker has no table " +
+                                                           table);
+                              }
+                              RunConfig taskConfig = runConfig;
+                              taskConfig.truncateFirst = attempt > 0;
+                              NodeStats stats;
+                              // One table at a time, so the file's growth is this one's
+                              const std::size_t before =
+                                  deadLetter ? deadLetter->count() : 0;
+                              migrateTable(*conf, taskConfig, myConfig, pgConfig,
+                                           &stats);
+                              const std::size_t after =
+                                  deadLetter ? deadLetter->count() : 0;
+                              return TaskResult{stats.rows, stats.bytes, after - before,
+                                                0};
+                          });
+    }
+
+    WorkerGate gate(max_threads);
+    std::atomic<std::size_t> tablesDone{0};
+    std::unique_ptr<ControlServer> control;
+    if (!controlPath.empty()) {
+        try {
+            control = std::make_unique<ControlServer>(
+                controlPath, throttle, gate, max_threads, [&tablesDone, &maps]() {
+                    return "tables " + std::to_string(tablesDone.load()) + "/" +
+                           std::to_string(maps.size()) + "\n";
+                });
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::unique_ptr<Maintenance> maintenance;
+    if (postLoadWorkers > 0) {
+        maintenance = std::make_unique<Maintenance>(
+            runConfig.shards.empty() ? std::vector<PgsqlConfig>{pgConfig}
+                                     : runConfig.shards,
+            postLoadWorkers, vacuumFreeze);
+    }
+
+    // Rows the worker processes rejected, from the attempt of each table that succeeded
+    std::uint64_t workerRejects = 0;
+    if (processCount > 0) {
+        std::vector<std::string> command(argv, argv + argc);
+        std::vector<std::string> tables;
+        for (const TableConf *conf : maps) {
+            tables.push_back(conf->tabName);
+        }
+        try {
+            ProcessPool pool(command, processCount, taskRetries);
+            const std::vector<std::size_t> failed = pool.run(
+                tables, [&](const std::size_t at, const TaskResult &r) {
+                    tablesDone++;
+                    workerRejects += r.rejected;
+                    std::cout << maps[at]->tabName << ": " << r.rows << " rows, "
+                              << (r.bytes >> 20) << " MiB in " << r.seconds << " s ("
+                              << tablesDone << "/" << maps.size() << " tables)"
+                              << std::endl;
+                    if (maintenance) {
+                        maintenance->enqueue(maps[at]->tabName);
+                    }
+                });
+            if (!failed.empty()) {
+                std::string names;
+                for (const std::size_t at : failed) {
+                    names += (names.empty() ? "" : ", ") + maps[at]->tabName;
+                }
+                throw std::runtime_error("Tables failed after retries: " + names);
+            }
+        } catch (...) {
+            eptr = std::current_exception();
+        }
+    } else {
         ThreadJoiner joiner{threads};
         for (std::uint32_t i = 0; i < max_threads; i++) {
-            threads.emplace_back([&maps, &next, &eptr, &stop, &myConfig, &pgConfig]() {
-                while (!stop) {
+            threads.emplace_back([&maps, &next, &eptr, &stop, &runConfig, &myConfig,
+                                  &pgConfig, &placements, &nodeStats, &maintenance,
+                                  &gate, &tablesDone, i]() {
+                NodeStats *stats = nullptr;
+                if (!placements.empty()) {
+                    // Before the first allocation, so this worker's buffers stay local
+                    try {
+                        applyPlacement(placements[i]);
+                    } catch (...) {
+                        if (!eptr) {
+                            eptr = std::current_exception();
+                        }
+                        stop = true;
+                        return;
+                    }
+                    const int node = placements[i].node;
+                    if (node >= 0 && static_cast<std::size_t>(node) < nodeStats.size()) {
+                        stats = &nodeStats[static_cast<std::size_t>(node)];
+                        stats->workers++;
+                    }
+                }
+                while (!stop && gate.enter()) {
                     const std::size_t at = next.fetch_add(1, std::memory_order_relaxed);
                     if (at >= maps.size()) {
+                        // Nothing left: release workers parked by a lowered limit
+                        gate.leave();
+                        gate.shutdown();
                         return;
                     }
                     try {
                         const auto &config = maps[at];
-                        migrateTable(config, useCSV, myConfig, pgConfig);
+                        migrateTable(config, runConfig, myConfig, pgConfig, stats);
+                        tablesDone++;
+                        if (maintenance) {
+                            maintenance->enqueue(config->tabName);
+                        }
                     } catch (...) {
                         if (!eptr) {
                             eptr = std::current_exception();
                         }
                         stop = true;
+                        gate.leave();
+                        gate.shutdown();
                         return;
                     }
+                    gate.leave();
                 }
             });
         }
     }
 
+    std::cout << "Peak RSS: " << (peakRSSBytes() >> 20) << " MiB, peak buffered: "
+              << (budget.peak() >> 10) << " KiB" << std::endl;
+    printNodeStats(nodeStats);
+#ifdef MIGRATE_TRACE
+    try {
+        writeTrace(tracePath);
+        std::cout << "Trace written to " << tracePath << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+#endif
+    if (deadLetter && deadLetter->count() + workerRejects > 0) {
+        std::cout << deadLetter->count() + workerRejects << " rows dead-lettered to "
+                  << deadLetterPath
+                  << (processCount > 0 ? " (failed attempts of retried tables may have "
+                                         "left more lines there)"
+                                       : "")
+                  << std::endl;
+    }
+
+    if (!eptr && !schemas.empty()) {
+        if (!runConfig.shards.empty()) {
+            // Sharded tables hold only part of what their foreign keys point at
+            std::cout << "Sharded run: constraints not added" << std::endl;
+        } else {
+            try {
+                const PgPtr pg = connectPG(pgConfig);
+                addConstraints(pg.get(), schemas);
+            } catch (...) {
+                eptr = std::current_exception();
+            }
+        }
+    }
+
+    if (maintenance) {
+        try {
+            maintenance->finish();
+        } catch (...) {
+            if (!eptr) {
+                eptr = std::current_exception();
+            }
+        }
+    }
+
     if (eptr) {
         try {
             std::rethrow_exception(eptr);
@@ -0,0 +1,143 @@
+#include "maintenance.hpp"
+#include "text.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <iostream>
+#include <utility>
+
+Maintenance::Maintenance(const std::vector<PgsqlConfig> &dests, const std::size_t workers,
+                         const bool vacuumFreeze)
+    : destinations(dests), freeze(vacuumFreeze) {
+    pool.reserve(workers);
+    for (std::size_t i = 0; i < workers; i++) {
+        pool.emplace_back([this]() { run(); });
+    }
+}
+
+Maintenance::~Maintenance() {
+    try {
+        finish();
+    } catch (...) {
+        // Already reported by whoever called finish()
+    }
+}
+
+void Maintenance::enqueue(const std::string &table) {
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        queue.push_back(table);
+    }
+    cv.notify_one();
+}
+
+void Maintenance::finish() {
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        closed = true;
+    }
+    cv.notify_all();
+    for (std::thread &t : pool) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+    if (error) {
+        std::rethrow_exception(std::exchange(error, nullptr));
+    }
+}
+
+void Maintenance::run() {
+    std::vector<PgPtr> conns;
+    try {
+        for (const PgsqlConfig &dest : destinations) {
+            conns.push_back(connectPG(dest));
+        }
+    } catch (...) {
+        const std::lock_guard<std::mutex> lock(m);
+        if (!error) {
+            error = std::current_exception();
+        }
+        return;
+    }
+    for (;;) {
+        std::string table;
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [this]() { return closed || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            table = std::move(queue.front());
+            queue.pop_front();
+        }
+        // One table failing still leaves the others maintained
+        try {
+            for (const PgPtr &pg : conns) {
+                maintain(pg.get(), table);
+            }
+        } catch (...) {
+            const std::lock_guard<std::mutex> lock(m);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+}
+
+static PGresult *checked(PGconn *pg, PGresult *r, const ExecStatusType want,
+                         const std::string &what) {
+    if (PQresultStatus(r) != want) {
+        const std::string error = what + " failed: " + PQerrorMessage(pg);
+        PQclear(r);
+        throw std::runtime_error(error);
+    }
+    return r;
+}
+
+void Maintenance::maintain(PGconn *pg, const std::string &table) {
+    TRACE_SPAN("maintain");
+    const auto start = std::chrono::steady_clock::now();
+    const std::string ident = quoteIdent(table);
+    // Covers identity columns as well as serials
+    const char *params[1] = {ident.c_str()};
+    PGresult *r = checked(
+        pg,
+        PQexecParams(pg,
+                     "SELECT a.attname, pg_get_serial_sequence($1, a.attname) "
+                     "FROM pg_attribute a WHERE a.attrelid = $1::regclass "
+                     "AND a.attnum > 0 AND NOT a.attisdropped "
+                     "AND pg_get_serial_sequence($1, a.attname) IS NOT NULL",
+                     1, nullptr, params, nullptr, nullptr, 0),
+        PGRES_TUPLES_OK, table + ": sequence lookup");
+    std::vector<std::pair<std::string, std::string>> sequences;
+    for (int i = 0; i < PQntuples(r); i++) {
+        sequences.emplace_back(PQgetvalue(r, i, 0), PQgetvalue(r, i, 1));
+    }
+    PQclear(r);
+
+    for (const auto &[column, sequence] : sequences) {
+        char *quoted = PQescapeIdentifier(pg, column.c_str(), column.size());
+        if (!quoted) {
+            throw std::runtime_error(table + ": " + PQerrorMessage(pg));
+        }
+        const std::string sql = "SELECT setval($1::regclass, COALESCE(MAX(" +
+                                std::string(quoted) + "), 0) + 1, false) FROM " + ident;
+        PQfreemem(quoted);
+        const char *seq[1] = {sequence.c_str()};
+        PQclear(checked(pg, PQexecParams(pg, sql.c_str(), 1, nullptr, seq, nullptr,
+                                         nullptr, 0),
+                        PGRES_TUPLES_OK, table + ": resetting " + sequence));
+    }
+
+    {
+        TRACE_SPAN("analyze");
+        const std::string sql =
+            (freeze ? "VACUUM (FREEZE, ANALYZE) " : "ANALYZE ") + ident;
+        PQclear(checked(pg, PQexec(pg, sql.c_str()), PGRES_COMMAND_OK, sql));
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << table << ": " << sequences.size() << " sequences reset, "
+              << (freeze ? "vacuumed" : "analyzed") << " in " << elapsed.count() << " s"
+              << std::endl;
+}
@@ -0,0 +1,86 @@
+#include "memory_budget.hpp"
+#include <algorithm>
+#include <sys/resource.h>
+
+MemoryBudget::MemoryBudget(const std::size_t limit) : cap(limit) {}
+
+bool MemoryBudget::fits(const std::size_t bytes) const {
+    return used == 0 || bytes <= cap - std::min(used, cap);
+}
+
+void MemoryBudget::take(const std::size_t bytes) {
+    used += bytes;
+    highWater = std::max(highWater, used);
+}
+
+bool MemoryBudget::tryAcquire(const std::size_t bytes) {
+    const std::lock_guard<std::mutex> lock(m);
+    if (!fits(bytes)) {
+        return false;
+    }
+    take(bytes);
+    return true;
+}
+
+void MemoryBudget::acquire(const std::size_t bytes) {
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [this, bytes]() { return fits(bytes); });
+    take(bytes);
+}
+
+void MemoryBudget::release(const std::size_t bytes) {
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        used -= std::min(used, bytes);
+    }
+    cv.notify_all();
+}
+
+std::size_t MemoryBudget::limit() const { return cap; }
+
+std::size_t MemoryBudget::peak() {
+    const std::lock_guard<std::mutex> lock(m);
+    return highWater;
+}
+
+BudgetLease::BudgetLease(MemoryBudget *_budget) : budget(_budget) {}
+
+BudgetLease::~BudgetLease() {
+    if (budget && bytesHeld > 0) {
+        budget->release(bytesHeld);
+    }
+}
+
+bool BudgetLease::tryGrow(const std::size_t bytes) {
+    if (budget && !budget->tryAcquire(bytes)) {
+        return false;
+    }
+    bytesHeld += bytes;
+    return true;
+}
+
+void BudgetLease::grow(const std::size_t bytes) {
+    if (budget) {
+        budget->acquire(bytes);
+    }
+    bytesHeld += bytes;
+}
+
+void BudgetLease::shrink(const std::size_t bytes) {
+    const std::size_t n = std::min(bytes, bytesHeld);
+    if (budget && n > 0) {
+        budget->release(n);
+    }
+    bytesHeld -= n;
+}
+
+std::size_t BudgetLease::held() const { return bytesHeld; }
+
+// ru_maxrss is reported in kilobytes on Linux
+std::size_t peakRSSBytes() {
+    struct rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+}
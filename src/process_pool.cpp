@@ -0,0 +1,255 @@
+#include "process_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Whole line or nothing, so a dead reader surfaces as false rather than SIGPIPE
+static bool writeLine(const int fd, const std::string &line) {
+    std::size_t at = 0;
+    while (at < line.size()) {
+        const ssize_t n = write(fd, line.data() + at, line.size() - at);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        at += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+int serveTasks(
+    const int taskFd, const int resultFd,
+    const std::function<TaskResult(const std::string &, unsigned)> &run) {
+    std::string pending;
+    char buf[256];
+    for (;;) {
+        const std::size_t end = pending.find('\n');
+        if (end == std::string::npos) {
+            const ssize_t n = read(taskFd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return 0;
+            }
+            pending.append(buf, static_cast<std::size_t>(n));
+            continue;
+        }
+        std::istringstream line(pending.substr(0, end));
+        pending.erase(0, end + 1);
+        std::size_t task = 0;
+        unsigned attempt = 0;
+        std::string name;
+        line >> task >> attempt;
+        std::getline(line >> std::ws, name);
+        std::ostringstream reply;
+        try {
+            const auto start = std::chrono::steady_clock::now();
+            TaskResult r = run(name, attempt);
+            r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                      start)
+                            .count();
+            reply << "done " << task << " " << r.rows << " " << r.bytes << " "
+                  << r.rejected << " " << r.seconds << "\n";
+        } catch (const std::exception &e) {
+            std::string reason = e.what();
+            std::replace(reason.begin(), reason.end(), '\n', ' ');
+            reply << "fail " << task << " " << reason << "\n";
+        }
+        if (!writeLine(resultFd, reply.str())) {
+            return 1;
+        }
+    }
+}
+
+ProcessPool::ProcessPool(std::vector<std::string> cmd, const std::size_t count,
+                         const unsigned maxRetries)
+    : command(std::move(cmd)), processes(std::max<std::size_t>(count, 1)),
+      retries(maxRetries) {
+    // A worker dying between tasks must not take the coordinator down with it
+    std::signal(SIGPIPE, SIG_IGN);
+}
+
+ProcessPool::~ProcessPool() {
+    for (Worker &w : workers) {
+        if (w.pid > 0) {
+            reap(w);
+        }
+    }
+}
+
+void ProcessPool::spawn(Worker &w) {
+    int tasks[2];
+    int results[2];
+    if (pipe2(tasks, O_CLOEXEC) < 0) {
+        throw std::runtime_error(std::string("Worker pipe failed: ") +
+                                 std::strerror(errno));
+    }
+    if (pipe2(results, O_CLOEXEC) < 0) {
+        const std::string error =
+            std::string("Worker pipe failed: ") + std::strerror(errno);
+        close(tasks[0]);
+        close(tasks[1]);
+        throw std::runtime_error(error);
+    }
+    // Built before forking: the child may only make async-signal-safe calls
+    std::vector<std::string> args = command;
+    args.emplace_back("--worker-fds");
+    args.push_back(std::to_string(tasks[0]) + "," + std::to_string(results[1]));
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        // Only the child's two ends survive the exec
+        fcntl(tasks[0], F_SETFD, 0);
+        fcntl(results[1], F_SETFD, 0);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    close(tasks[0]);
+    close(results[1]);
+    if (pid < 0) {
+        const std::string error =
+            std::string("Worker fork failed: ") + std::strerror(errno);
+        close(tasks[1]);
+        close(results[0]);
+        throw std::runtime_error(error);
+    }
+    w = Worker{};
+    w.pid = pid;
+    w.taskFd = tasks[1];
+    w.resultFd = results[0];
+}
+
+// Close the worker's pipes, so an idle one exits, and describe how it ended
+std::string ProcessPool::reap(Worker &w) {
+    close(w.taskFd);
+    close(w.resultFd);
+    int status = 0;
+    while (waitpid(w.pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    w.pid = -1;
+    if (WIFSIGNALED(status)) {
+        return std::string("killed by ") + strsignal(WTERMSIG(status));
+    }
+    return "exited with status " + std::to_string(WEXITSTATUS(status));
+}
+
+std::vector<std::size_t>
+ProcessPool::run(const std::vector<std::string> &names,
+                 const std::function<void(std::size_t, const TaskResult &)> &done) {
+    const std::size_t tasks = names.size();
+    std::deque<std::size_t> queue;
+    for (std::size_t i = 0; i < tasks; i++) {
+        queue.push_back(i);
+    }
+    std::vector<unsigned> attempts(tasks, 0);
+    std::vector<std::size_t> failed;
+    std::size_t finished = 0;
+    const auto retry = [&](const std::size_t task, const std::string &reason) {
+        std::cerr << names[task] << " failed (attempt " << attempts[task] + 1
+                  << "): " << reason << std::endl;
+        if (++attempts[task] > retries) {
+            failed.push_back(task);
+            finished++;
+        } else {
+            queue.push_back(task);
+        }
+    };
+
+    workers.resize(std::min(processes, tasks));
+    for (Worker &w : workers) {
+        spawn(w);
+    }
+    while (finished < tasks) {
+        for (Worker &w : workers) {
+            if (w.pid < 0 && !queue.empty()) {
+                spawn(w);
+            }
+            if (w.pid > 0 && !w.task && !queue.empty()) {
+                w.task = queue.front();
+                queue.pop_front();
+                // A failed write shows up as the worker's pipe closing below
+                writeLine(w.taskFd, std::to_string(*w.task) + " " +
+                                        std::to_string(attempts[*w.task]) + " " +
+                                        names[*w.task] + "\n");
+            }
+        }
+        std::vector<pollfd> fds;
+        std::vector<Worker *> polled;
+        for (Worker &w : workers) {
+            if (w.pid > 0) {
+                fds.push_back({w.resultFd, POLLIN, 0});
+                polled.push_back(&w);
+            }
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Worker poll failed: ") +
+                                     std::strerror(errno));
+        }
+        for (std::size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            Worker &w = *polled[i];
+            char buf[4096];
+            const ssize_t n = read(w.resultFd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                const pid_t pid = w.pid;
+                const std::string how = reap(w);
+                std::cerr << "Worker " << pid << " " << how << std::endl;
+                if (w.task) {
+                    retry(*w.task, "worker " + how);
+                }
+                w.task.reset();
+                continue;
+            }
+            w.pending.append(buf, static_cast<std::size_t>(n));
+            std::size_t end;
+            while ((end = w.pending.find('\n')) != std::string::npos) {
+                std::istringstream line(w.pending.substr(0, end));
+                w.pending.erase(0, end + 1);
+                std::string kind;
+                std::size_t task = 0;
+                line >> kind >> task;
+                if (!w.task || task != *w.task) {
+                    continue;
+                }
+                w.task.reset();
+                if (kind == "done") {
+                    TaskResult r;
+                    line >> r.rows >> r.bytes >> r.rejected >> r.seconds;
+                    finished++;
+                    done(task, r);
+                } else {
+                    std::string reason;
+                    std::getline(line >> std::ws, reason);
+                    retry(task, reason);
+                }
+            }
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,88 @@
+#include "replicas.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+ReplicaSet::ReplicaSet(std::vector<MysqlConfig> replicas)
+    : configs(std::move(replicas)), open(configs.size(), 0), served(configs.size(), 0) {
+    if (configs.empty()) {
+        throw std::runtime_error("A replica set needs at least one replica");
+    }
+}
+
+static std::string address(const MysqlConfig &c) {
+    return c.myhost + ":" + std::to_string(c.myport);
+}
+
+void ReplicaSet::waitFor(const std::string &gtid, const double timeoutSecs) const {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::duration<double>(timeoutSecs);
+    for (const MysqlConfig &replica : configs) {
+        const MysqlPtr conn = connectMysql(replica);
+        const double left = std::max(
+            std::chrono::duration<double>(deadline - std::chrono::steady_clock::now())
+                .count(),
+            0.0);
+        std::string escaped(gtid.size() * 2 + 1, '\0');
+        escaped.resize(mysql_real_escape_string(conn.get(), escaped.data(), gtid.c_str(),
+                                                gtid.size()));
+        // 0 once applied, -1 on timeout, NULL if the position cannot be waited for
+        const std::string sql = "SELECT MASTER_GTID_WAIT('" + escaped + "', " +
+                                std::to_string(left) + ")";
+        if (mysql_query(conn.get(), sql.c_str())) {
+            throw std::runtime_error("Replica " + address(replica) +
+                                     " lag check failed: " + mysql_error(conn.get()));
+        }
+        const MysqlResPtr r(mysql_store_result(conn.get()));
+        const MYSQL_ROW row = r ? mysql_fetch_row(r.get()) : nullptr;
+        if (!row || !row[0]) {
+            throw std::runtime_error("Replica " + address(replica) +
+                                     " cannot wait for GTID " + gtid);
+        }
+        if (std::string(row[0]) != "0") {
+            throw std::runtime_error("Replica " + address(replica) +
+                                     " has not reached GTID " + gtid + " after " +
+                                     std::to_string(timeoutSecs) + " s");
+        }
+    }
+}
+
+std::size_t ReplicaSet::acquire() {
+    const std::lock_guard<std::mutex> lock(m);
+    std::size_t best = 0;
+    for (std::size_t i = 1; i < configs.size(); i++) {
+        if (open[i] < open[best] || (open[i] == open[best] && served[i] < served[best])) {
+            best = i;
+        }
+    }
+    open[best]++;
+    served[best]++;
+    return best;
+}
+
+void ReplicaSet::release(const std::size_t replica) {
+    const std::lock_guard<std::mutex> lock(m);
+    open[replica]--;
+}
+
+const MysqlConfig &ReplicaSet::config(const std::size_t replica) const {
+    return configs[replica];
+}
+
+std::size_t ReplicaSet::size() const { return configs.size(); }
+
+std::string primaryPosition(const MysqlConfig &primary) {
+    const MysqlPtr conn = connectMysql(primary);
+    if (mysql_query(conn.get(), "SELECT @@GLOBAL.gtid_binlog_pos")) {
+        throw std::runtime_error(std::string("MySQL GTID query failed: ") +
+                                 mysql_error(conn.get()));
+    }
+    const MysqlResPtr r(mysql_store_result(conn.get()));
+    const MYSQL_ROW row = r ? mysql_fetch_row(r.get()) : nullptr;
+    const std::string gtid = (row && row[0]) ? row[0] : "";
+    if (gtid.empty()) {
+        throw std::runtime_error("Source has no binlog GTID position to check replicas "
+                                 "against; is log_bin enabled?");
+    }
+    return gtid;
+}
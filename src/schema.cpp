@@ -0,0 +1,357 @@
+#include "schema.hpp"
+#include "text.hpp"
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+struct SourceColumn {
+    std::string name;
+    std::string dataType;
+    std::string columnType;
+    bool nullable;
+    std::string length;
+    std::string precision;
+    std::string scale;
+    std::string fraction;
+    bool autoIncrement;
+};
+
+struct ColumnPlan {
+    PgType type;
+    std::string sqlType;
+    bool fixed = false;
+    unsigned digits = 0;
+};
+
+struct SourceKey {
+    std::string type;
+    std::vector<std::string> columns;
+    std::string refTable;
+    std::vector<std::string> refColumns;
+};
+
+static MysqlResPtr queryMysql(MYSQL *mysql, const std::string &sql) {
+    if (mysql_query(mysql, sql.c_str())) {
+        std::string error = std::string("Schema query failed: ") + mysql_error(mysql);
+        throw std::runtime_error(error);
+    }
+    MysqlResPtr r(mysql_store_result(mysql));
+    if (!r) {
+        throw std::runtime_error("mysql_store_result failed");
+    }
+    return r;
+}
+
+static std::string field(const MYSQL_ROW &row, const int i) {
+    return row[i] ? row[i] : "";
+}
+
+static std::string joined(const std::vector<std::string> &names) {
+    std::string out;
+    for (const std::string &name : names) {
+        out += (out.empty() ? "" : ", ") + name;
+    }
+    return out;
+}
+
+static std::string joinedIdents(const std::vector<std::string> &names) {
+    std::string out;
+    for (const std::string &name : names) {
+        out += (out.empty() ? "" : ", ") + quoteIdent(name);
+    }
+    return out;
+}
+
+static std::string quoteLiteral(const std::string &s) {
+    std::string out = "'";
+    for (const char c : s) {
+        out += c == '\'' ? "''" : std::string(1, c);
+    }
+    return out + "'";
+}
+
+// Neither CREATE TYPE nor ADD CONSTRAINT has IF NOT EXISTS
+static std::string ifAbsent(const std::string &sql) {
+    return "DO $$ BEGIN " + sql +
+           "; EXCEPTION WHEN duplicate_object OR duplicate_table THEN NULL; END $$";
+}
+
+// enum('a','it''s') as {"a", "it's"}
+static std::vector<std::string> enumValues(const std::string &columnType) {
+    std::vector<std::string> values;
+    std::string value;
+    bool quoted = false;
+    for (std::size_t i = columnType.find('(') + 1; i < columnType.size(); i++) {
+        const char c = columnType[i];
+        if (!quoted) {
+            quoted = c == '\'';
+            value.clear();
+        } else if (c != '\'') {
+            value += c;
+        } else if (i + 1 < columnType.size() && columnType[i + 1] == '\'') {
+            value += c;
+            i++;
+        } else {
+            quoted = false;
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+/**
+ * The narrowest PostgreSQL type holding every value of the MariaDB column. Unsigned
+ * types widen one step, bigint unsigned to numeric(20) unless it is an auto-increment
+ * key; tinyint(1) is only taken as boolean, as MariaDB clients conventionally do, when
+ * tinyintBool asks for it, since the column can still hold -128..127.
+ * DATETIME becomes timestamp and TIMESTAMP, which MariaDB stores in UTC and every
+ * connection reads back in UTC, timestamptz.
+ * SET becomes text[] with one element per member.
+ */
+static ColumnPlan mapColumn(const std::string &table, const SourceColumn &c,
+                            const bool json, const bool tinyintBool,
+                            std::vector<std::string> &ddl) {
+    const std::string &t = c.dataType;
+    const bool isUnsigned = c.columnType.find("unsigned") != std::string::npos;
+    const std::string fraction = "(" + (c.fraction.empty() ? "0" : c.fraction) + ")";
+    const auto digits =
+        static_cast<unsigned>(c.fraction.empty() ? 0 : std::stoul(c.fraction));
+    if (t == "tinyint") {
+        if (tinyintBool && c.columnType.rfind("tinyint(1)", 0) == 0) {
+            return {PgType::BOOL, "boolean"};
+        }
+        return {PgType::INT16, "smallint"};
+    }
+    if (t == "smallint") {
+        return isUnsigned ? ColumnPlan{PgType::INT32, "integer"}
+                          : ColumnPlan{PgType::INT16, "smallint"};
+    }
+    if (t == "year") {
+        return {PgType::INT16, "smallint"};
+    }
+    if (t == "mediumint") {
+        return {PgType::INT32, "integer"};
+    }
+    if (t == "int" || t == "integer") {
+        return isUnsigned ? ColumnPlan{PgType::INT64, "bigint"}
+                          : ColumnPlan{PgType::INT32, "integer"};
+    }
+    if (t == "bigint") {
+        return isUnsigned && !c.autoIncrement ? ColumnPlan{PgType::NUMERIC, "numeric(20)"}
+                                              : ColumnPlan{PgType::INT64, "bigint"};
+    }
+    if (t == "decimal" || t == "numeric") {
+        return {PgType::NUMERIC, "numeric(" + c.precision + "," + c.scale + ")"};
+    }
+    if (t == "float") {
+        return {PgType::FLOAT4, "real"};
+    }
+    if (t == "double" || t == "real") {
+        return {PgType::FLOAT8, "double precision"};
+    }
+    if (t == "json" || json) {
+        return {PgType::JSONB, "jsonb"};
+    }
+    if (t == "char" || t == "varchar") {
+        return {PgType::TEXT, t + "(" + c.length + ")"};
+    }
+    if (t == "tinytext" || t == "text" || t == "mediumtext" || t == "longtext") {
+        return {PgType::TEXT, "text"};
+    }
+    if (t == "set") {
+        return {PgType::TEXT_ARRAY, "text[]"};
+    }
+    if (t == "enum") {
+        const std::string type = quoteIdent(table + "_" + c.name);
+        std::vector<std::string> labels;
+        for (const std::string &value : enumValues(c.columnType)) {
+            labels.push_back(quoteLiteral(value));
+        }
+        ddl.push_back(ifAbsent("CREATE TYPE " + type + " AS ENUM (" + joined(labels) +
+                               ")"));
+        return {PgType::ENUM, type};
+    }
+    if (t == "binary" || t == "varbinary" || t == "tinyblob" || t == "blob" ||
+        t == "mediumblob" || t == "longblob" || t == "bit") {
+        return {PgType::BYTEA, "bytea"};
+    }
+    if (t == "date") {
+        return {PgType::DATE, "date", true, 0};
+    }
+    if (t == "time") {
+        return {PgType::TIME, "time" + fraction};
+    }
+    if (t == "datetime") {
+        return {PgType::TIMESTAMP, "timestamp" + fraction, true, digits};
+    }
+    if (t == "timestamp") {
+        return {PgType::TIMESTAMPTZ, "timestamptz" + fraction, true, digits};
+    }
+    if (t == "uuid") {
+        return {PgType::UUID, "uuid"};
+    }
+    if (t == "inet4" || t == "inet6") {
+        return {PgType::INET, "inet"};
+    }
+    throw std::runtime_error("Unsupported MariaDB type " + c.columnType + " for " +
+                             table + "." + c.name);
+}
+
+std::vector<TableSchema> introspect(MYSQL *mysql, const std::vector<std::string> &only,
+                                    const bool tinyintBool) {
+    std::map<std::string, std::vector<SourceColumn>> tables;
+    {
+        const MysqlResPtr r = queryMysql(
+            mysql, "SELECT c.TABLE_NAME, c.COLUMN_NAME, LOWER(c.DATA_TYPE), "
+                   "c.COLUMN_TYPE, c.IS_NULLABLE, c.CHARACTER_MAXIMUM_LENGTH, "
+                   "c.NUMERIC_PRECISION, c.NUMERIC_SCALE, c.DATETIME_PRECISION, c.EXTRA "
+                   "FROM information_schema.COLUMNS c JOIN information_schema.TABLES t "
+                   "ON t.TABLE_SCHEMA = c.TABLE_SCHEMA AND t.TABLE_NAME = c.TABLE_NAME "
+                   "WHERE c.TABLE_SCHEMA = DATABASE() AND t.TABLE_TYPE = 'BASE TABLE' "
+                   "ORDER BY c.TABLE_NAME, c.ORDINAL_POSITION");
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(r.get()))) {
+            tables[field(row, 0)].push_back(
+                {field(row, 1), field(row, 2), field(row, 3), field(row, 4) == "YES",
+                 field(row, 5), field(row, 6), field(row, 7), field(row, 8),
+                 field(row, 9).find("auto_increment") != std::string::npos});
+        }
+    }
+    for (const std::string &name : only) {
+        if (tables.find(name) == tables.end()) {
+            throw std::runtime_error("No such source table: " + name);
+        }
+    }
+
+    // Constraint name -> key, per table, with columns in key order
+    std::map<std::string, std::map<std::string, SourceKey>> keys;
+    {
+        const MysqlResPtr r = queryMysql(
+            mysql, "SELECT k.TABLE_NAME, k.CONSTRAINT_NAME, c.CONSTRAINT_TYPE, "
+                   "k.COLUMN_NAME, k.REFERENCED_TABLE_NAME, k.REFERENCED_COLUMN_NAME "
+                   "FROM information_schema.KEY_COLUMN_USAGE k "
+                   "JOIN information_schema.TABLE_CONSTRAINTS c "
+                   "ON c.CONSTRAINT_SCHEMA = k.CONSTRAINT_SCHEMA "
+                   "AND c.TABLE_NAME = k.TABLE_NAME "
+                   "AND c.CONSTRAINT_NAME = k.CONSTRAINT_NAME "
+                   "WHERE k.TABLE_SCHEMA = DATABASE() "
+                   "ORDER BY k.TABLE_NAME, k.CONSTRAINT_NAME, k.ORDINAL_POSITION");
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(r.get()))) {
+            SourceKey &key = keys[field(row, 0)][field(row, 1)];
+            key.type = field(row, 2);
+            key.columns.push_back(field(row, 3));
+            key.refTable = field(row, 4);
+            if (row[5]) {
+                key.refColumns.push_back(row[5]);
+            }
+        }
+    }
+
+    // MariaDB's JSON is LONGTEXT with a json_valid(`col`) check
+    std::map<std::string, std::set<std::string>> jsonColumns;
+    {
+        const MysqlResPtr r = queryMysql(
+            mysql, "SELECT TABLE_NAME, CHECK_CLAUSE "
+                   "FROM information_schema.CHECK_CONSTRAINTS "
+                   "WHERE CONSTRAINT_SCHEMA = DATABASE() "
+                   "AND CHECK_CLAUSE LIKE 'json_valid(`%`)'");
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(r.get()))) {
+            const std::string clause = field(row, 1);
+            const std::size_t open = clause.find('`');
+            const std::size_t close = clause.rfind('`');
+            jsonColumns[field(row, 0)].insert(clause.substr(open + 1, close - open - 1));
+        }
+    }
+
+    const std::set<std::string> wanted(only.begin(), only.end());
+    std::vector<TableSchema> schemas;
+    for (const auto &[table, columns] : tables) {
+        if (!wanted.empty() && wanted.count(table) == 0) {
+            continue;
+        }
+        std::map<std::string, PgType> mapping;
+        std::map<std::string, unsigned> fixed;
+        std::vector<std::string> ddl;
+        std::vector<std::string> defs;
+        std::string watermark;
+        const std::set<std::string> &json = jsonColumns[table];
+        for (const SourceColumn &c : columns) {
+            const ColumnPlan plan =
+                mapColumn(table, c, json.count(c.name) > 0, tinyintBool, ddl);
+            mapping.emplace(c.name, plan.type);
+            if (plan.fixed) {
+                fixed.emplace(c.name, plan.digits);
+            }
+            std::string def = quoteIdent(c.name) + " " + plan.sqlType;
+            if (c.autoIncrement) {
+                def += " GENERATED BY DEFAULT AS IDENTITY";
+            }
+            defs.push_back(c.nullable ? def : def + " NOT NULL");
+            if (c.name == "updated_at") {
+                watermark = c.name;
+            }
+        }
+
+        std::string keyCol;
+        std::vector<std::string> constraints;
+        for (const auto &[name, key] : keys[table]) {
+            const std::string cols = joinedIdents(key.columns);
+            const std::string alter = "ALTER TABLE " + quoteIdent(table) +
+                                      " ADD CONSTRAINT " + quoteIdent(table + "_" + name);
+            if (key.type == "PRIMARY KEY") {
+                // Kept inline: incremental merges need it as their conflict target
+                defs.push_back("PRIMARY KEY (" + cols + ")");
+                keyCol = key.columns.size() == 1 ? key.columns[0] : "";
+            } else if (key.type == "UNIQUE") {
+                constraints.push_back(ifAbsent(alter + " UNIQUE (" + cols + ")"));
+            } else if (key.type == "FOREIGN KEY") {
+                if (!wanted.empty() && wanted.count(key.refTable) == 0) {
+                    std::cout << table << ": skipping foreign key " << name
+                              << " to unmigrated " << key.refTable << std::endl;
+                    continue;
+                }
+                constraints.push_back(
+                    ifAbsent(alter + " FOREIGN KEY (" + cols + ") REFERENCES " +
+                             quoteIdent(key.refTable) + " (" +
+                             joinedIdents(key.refColumns) +
+                             ") DEFERRABLE INITIALLY DEFERRED"));
+            }
+        }
+        ddl.push_back("CREATE TABLE IF NOT EXISTS " + quoteIdent(table) + " (" +
+                      joined(defs) + ")");
+        if (!watermark.empty() && keyCol.empty()) {
+            // A merge needs a single-column key as its conflict target
+            std::cout << table << ": no single-column primary key to merge on, so "
+                      << "no watermark; --incremental will refuse it" << std::endl;
+            watermark.clear();
+        }
+
+        schemas.push_back({TableConf{.tabName = table,
+                                     .map = mapping,
+                                     .keyCol = keyCol,
+                                     .watermarkCol = watermark,
+                                     .fixedTemporal = fixed,
+                                     .ddl = ddl},
+                           constraints});
+    }
+    return schemas;
+}
+
+void addConstraints(PGconn *pg, const std::vector<TableSchema> &schemas) {
+    for (const TableSchema &schema : schemas) {
+        for (const std::string &sql : schema.constraints) {
+            PGresult *r = PQexec(pg, sql.c_str());
+            if (PQresultStatus(r) != PGRES_COMMAND_OK) {
+                const std::string error = schema.conf.tabName +
+                                          ": adding constraint failed: " +
+                                          PQerrorMessage(pg);
+                PQclear(r);
+                throw std::runtime_error(error);
+            }
+            PQclear(r);
+        }
+    }
+}
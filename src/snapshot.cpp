@@ -0,0 +1,54 @@
+#include "snapshot.hpp"
+#include <stdexcept>
+
+static void execMysql(MYSQL *conn, const std::string &sql) {
+    if (mysql_query(conn, sql.c_str())) {
+        std::string error =
+            "MySQL snapshot setup failed (" + sql + "): " + mysql_error(conn);
+        throw std::runtime_error(error);
+    }
+}
+
+SnapshotPool::SnapshotPool(const MysqlConfig &myConfig, const std::size_t size) {
+    // Connect first so the global lock is only held for the snapshot statements
+    idle.reserve(size);
+    for (std::size_t i = 0; i < size; i++) {
+        idle.push_back(connectMysql(myConfig));
+        execMysql(idle.back().get(),
+                  "SET SESSION TRANSACTION ISOLATION LEVEL REPEATABLE READ");
+    }
+    const MysqlPtr coordinator = connectMysql(myConfig);
+    execMysql(coordinator.get(), "FLUSH TABLES WITH READ LOCK");
+    try {
+        for (const auto &conn : idle) {
+            execMysql(conn.get(),
+                      "START TRANSACTION WITH CONSISTENT SNAPSHOT, READ ONLY");
+        }
+        execMysql(coordinator.get(), "SELECT @@GLOBAL.gtid_binlog_pos");
+        const MysqlResPtr r(mysql_store_result(coordinator.get()));
+        const MYSQL_ROW row = r ? mysql_fetch_row(r.get()) : nullptr;
+        gtid = (row && row[0]) ? row[0] : "";
+    } catch (...) {
+        mysql_query(coordinator.get(), "UNLOCK TABLES");
+        throw;
+    }
+    execMysql(coordinator.get(), "UNLOCK TABLES");
+}
+
+MysqlPtr SnapshotPool::take() {
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [this]() { return !idle.empty(); });
+    MysqlPtr conn = std::move(idle.back());
+    idle.pop_back();
+    return conn;
+}
+
+void SnapshotPool::give(MysqlPtr conn) {
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        idle.push_back(std::move(conn));
+    }
+    cv.notify_one();
+}
+
+const std::string &SnapshotPool::position() const { return gtid; }
@@ -0,0 +1,128 @@
+#include "throttle.hpp"
+#include <algorithm>
+
+void Throttle::setLimits(const double rowsPerSec, const double bytesPerSec) {
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        refill();
+        rowRate = std::max(rowsPerSec, 0.0);
+        byteRate = std::max(bytesPerSec, 0.0);
+        // No credit carries into a new limit; debt owed by waiting workers does
+        rowTokens = rowRate > 0 ? std::min(rowTokens, 0.0) : 0;
+        byteTokens = byteRate > 0 ? std::min(byteTokens, 0.0) : 0;
+        limited = rowRate > 0 || byteRate > 0;
+        rowCharge = rowRate > 0 ? std::clamp<std::size_t>(
+                                      static_cast<std::size_t>(rowRate / 10), 1,
+                                      maxChargeRows)
+                                : maxChargeRows;
+        byteCharge = byteRate > 0 ? std::clamp<std::size_t>(
+                                        static_cast<std::size_t>(byteRate / 10), 1,
+                                        maxChargeBytes)
+                                  : maxChargeBytes;
+    }
+    cv.notify_all();
+}
+
+double Throttle::rowLimit() {
+    const std::lock_guard<std::mutex> lock(m);
+    return rowRate;
+}
+
+double Throttle::byteLimit() {
+    const std::lock_guard<std::mutex> lock(m);
+    return byteRate;
+}
+
+void Throttle::refill() {
+    const auto now = std::chrono::steady_clock::now();
+    const double secs = std::chrono::duration<double>(now - last).count();
+    last = now;
+    rowTokens = std::min(rowTokens + secs * rowRate, rowRate);
+    byteTokens = std::min(byteTokens + secs * byteRate, byteRate);
+}
+
+void Throttle::take(const std::size_t rows, const std::size_t bytes) {
+    rowCount.fetch_add(rows, std::memory_order_relaxed);
+    byteCount.fetch_add(bytes, std::memory_order_relaxed);
+    if (!limited.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m);
+    refill();
+    rowTokens -= rowRate > 0 ? static_cast<double>(rows) : 0;
+    byteTokens -= byteRate > 0 ? static_cast<double>(bytes) : 0;
+    for (;;) {
+        double wait = 0;
+        if (rowRate > 0 && rowTokens < 0) {
+            wait = std::max(wait, -rowTokens / rowRate);
+        }
+        if (byteRate > 0 && byteTokens < 0) {
+            wait = std::max(wait, -byteTokens / byteRate);
+        }
+        if (wait <= 0) {
+            return;
+        }
+        cv.wait_for(lock, std::chrono::duration<double>(wait));
+        refill();
+    }
+}
+
+std::size_t Throttle::chargeRows() const {
+    return rowCharge.load(std::memory_order_relaxed);
+}
+
+std::size_t Throttle::chargeBytes() const {
+    return byteCharge.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Throttle::rows() const { return rowCount.load(std::memory_order_relaxed); }
+
+std::uint64_t Throttle::bytes() const {
+    return byteCount.load(std::memory_order_relaxed);
+}
+
+WorkerGate::WorkerGate(const std::size_t limit) : cap(limit) {}
+
+bool WorkerGate::enter() {
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [this]() { return closed || inside < cap; });
+    if (closed) {
+        return false;
+    }
+    inside++;
+    return true;
+}
+
+void WorkerGate::leave() {
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        inside--;
+    }
+    cv.notify_one();
+}
+
+void WorkerGate::setLimit(const std::size_t limit) {
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        cap = limit;
+    }
+    cv.notify_all();
+}
+
+void WorkerGate::shutdown() {
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        closed = true;
+    }
+    cv.notify_all();
+}
+
+std::size_t WorkerGate::active() {
+    const std::lock_guard<std::mutex> lock(m);
+    return inside;
+}
+
+std::size_t WorkerGate::limit() {
+    const std::lock_guard<std::mutex> lock(m);
+    return cap;
+}
@@ -0,0 +1,315 @@
+#include "time_zone.hpp"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+static const std::int64_t beginningOfTime = std::numeric_limits<std::int64_t>::min();
+static const std::int32_t lastRuleYear = 2100;
+
+static std::int64_t readBE(const std::string &data, const std::size_t at,
+                           const std::size_t width) {
+    if (at + width > data.size()) {
+        throw std::runtime_error("Truncated TZif data");
+    }
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < width; i++) {
+        v = (v << 8) | static_cast<unsigned char>(data[at + i]);
+    }
+    if (width < 8 && (v >> ((width * 8) - 1)) != 0) {
+        v |= ~((std::uint64_t{1} << (width * 8)) - 1); // Sign-extend
+    }
+    return static_cast<std::int64_t>(v);
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+static std::int64_t daysFromCivil(std::int64_t y, const std::int64_t m,
+                                  const std::int64_t d) {
+    y -= m <= 2 ? 1 : 0;
+    const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const std::int64_t yoe = y - (era * 400);
+    const std::int64_t doy = (((153 * (m + (m > 2 ? -3 : 9))) + 2) / 5) + d - 1;
+    const std::int64_t doe = (yoe * 365) + (yoe / 4) - (yoe / 100) + doy;
+    return (era * 146097) + doe - 719468;
+}
+
+static bool isLeap(const std::int64_t y) {
+    return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+static std::int64_t yearOf(const std::int64_t utc) {
+    std::int64_t y = 1970 + (utc / (365 * 86400LL + 20952)); // Approximate, then fix up
+    while (daysFromCivil(y, 1, 1) * 86400 > utc) {
+        y--;
+    }
+    while (daysFromCivil(y + 1, 1, 1) * 86400 <= utc) {
+        y++;
+    }
+    return y;
+}
+
+/**
+ * Minimal POSIX TZ string reader for TZif footers, e.g. "EST5EDT,M3.2.0,M11.1.0" or
+ * "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0". Offsets are returned east-positive.
+ */
+class PosixRule {
+  public:
+    explicit PosixRule(const std::string &s) : str(s) {
+        skipName();
+        stdOffset = -parseTime();
+        if (pos == str.size()) {
+            return;
+        }
+        hasDst = true;
+        skipName();
+        dstOffset = stdOffset + 3600;
+        if (pos < str.size() && str[pos] != ',') {
+            dstOffset = -parseTime();
+        }
+        if (pos >= str.size() || str[pos] != ',') {
+            throw std::runtime_error("Unsupported TZ rule: " + str);
+        }
+        pos++;
+        start = parseDate();
+        pos++; // ','
+        end = parseDate();
+    }
+
+    std::int32_t stdOffset = 0;
+    std::int32_t dstOffset = 0;
+    bool hasDst = false;
+
+    // UTC instants where DST starts and ends in year y
+    std::pair<std::int64_t, std::int64_t> transitions(const std::int64_t y) const {
+        return {(dayOf(start, y) * 86400) + start.time - stdOffset,
+                (dayOf(end, y) * 86400) + end.time - dstOffset};
+    }
+
+  private:
+    struct Date {
+        char kind = 'M'; // 'J' (1-365, no leap day), 'N' (0-365) or 'M' (month.week.day)
+        std::int32_t a = 0;
+        std::int32_t b = 0;
+        std::int32_t c = 0;
+        std::int64_t time = 7200;
+    };
+
+    const std::string str;
+    std::size_t pos = 0;
+    Date start;
+    Date end;
+
+    void skipName() {
+        if (pos < str.size() && str[pos] == '<') {
+            pos = str.find('>', pos);
+            if (pos == std::string::npos) {
+                throw std::runtime_error("Unterminated TZ name: " + str);
+            }
+            pos++;
+            return;
+        }
+        while (pos < str.size() && std::isalpha(static_cast<unsigned char>(str[pos]))) {
+            pos++;
+        }
+    }
+
+    std::int32_t parseNumber() {
+        std::int32_t n = 0;
+        if (pos >= str.size() || !std::isdigit(static_cast<unsigned char>(str[pos]))) {
+            throw std::runtime_error("Invalid TZ rule: " + str);
+        }
+        while (pos < str.size() && std::isdigit(static_cast<unsigned char>(str[pos]))) {
+            n = (n * 10) + (str[pos++] - '0');
+        }
+        return n;
+    }
+
+    // [+-]hh[:mm[:ss]] in seconds
+    std::int32_t parseTime() {
+        std::int32_t sign = 1;
+        if (pos < str.size() && (str[pos] == '+' || str[pos] == '-')) {
+            sign = str[pos++] == '-' ? -1 : 1;
+        }
+        std::int32_t secs = parseNumber() * 3600;
+        if (pos < str.size() && str[pos] == ':') {
+            pos++;
+            secs += parseNumber() * 60;
+            if (pos < str.size() && str[pos] == ':') {
+                pos++;
+                secs += parseNumber();
+            }
+        }
+        return sign * secs;
+    }
+
+    Date parseDate() {
+        Date d;
+        if (pos < str.size() && str[pos] == 'M') {
+            pos++;
+            d.a = parseNumber();
+            pos++; // '.'
+            d.b = parseNumber();
+            pos++; // '.'
+            d.c = parseNumber();
+        } else if (pos < str.size() && str[pos] == 'J') {
+            pos++;
+            d.kind = 'J';
+            d.a = parseNumber();
+        } else {
+            d.kind = 'N';
+            d.a = parseNumber();
+        }
+        if (pos < str.size() && str[pos] == '/') {
+            pos++;
+            d.time = parseTime();
+        }
+        return d;
+    }
+
+    static std::int64_t dayOf(const Date &d, const std::int64_t y) {
+        const std::int64_t jan1 = daysFromCivil(y, 1, 1);
+        if (d.kind == 'J') {
+            return jan1 + d.a - 1 + (isLeap(y) && d.a >= 60 ? 1 : 0);
+        }
+        if (d.kind == 'N') {
+            return jan1 + d.a;
+        }
+        // Day c (0 = Sunday) of week b (5 = last) of month a
+        const std::int64_t first = daysFromCivil(y, d.a, 1);
+        const std::int64_t firstDow = (first + 4) % 7; // 1970-01-01 was a Thursday
+        std::int64_t day = first + ((d.c - firstDow + 7) % 7) + ((d.b - 1) * 7);
+        const std::int64_t nextMonth =
+            d.a == 12 ? daysFromCivil(y + 1, 1, 1) : daysFromCivil(y, d.a + 1, 1);
+        while (day >= nextMonth) {
+            day -= 7;
+        }
+        return day;
+    }
+};
+
+std::shared_ptr<const TimeZone> TimeZone::load(const std::string &name) {
+    static std::mutex m;
+    static std::map<std::string, std::shared_ptr<const TimeZone>> zones;
+    const std::lock_guard<std::mutex> lock(m);
+    auto it = zones.find(name);
+    if (it == zones.end()) {
+        it = zones.emplace(name, std::make_shared<const TimeZone>(name)).first;
+    }
+    return it->second;
+}
+
+TimeZone::TimeZone(const std::string &name) {
+    if (name.empty() || name.find("..") != std::string::npos) {
+        throw std::invalid_argument("Invalid time zone name: " + name);
+    }
+    const std::string path = "/usr/share/zoneinfo/" + name;
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open time zone file: " + path);
+    }
+    std::ostringstream buf;
+    buf << in.rdbuf();
+    parseTZif(buf.str(), name);
+    localStarts.reserve(utcStarts.size());
+    for (std::size_t i = 0; i < utcStarts.size(); i++) {
+        localStarts.push_back(i == 0 ? beginningOfTime : utcStarts[i] + offsets[i]);
+    }
+}
+
+/**
+ * TZif (RFC 8536): v1 block with 32-bit times, then for v2+ a second block with 64-bit
+ * times followed by a newline-delimited POSIX TZ footer for instants past the table.
+ */
+void TimeZone::parseTZif(const std::string &data, const std::string &name) {
+    if (data.size() < 44 || data.compare(0, 4, "TZif") != 0) {
+        throw std::runtime_error("Not a TZif file: " + name);
+    }
+    const char version = data[4];
+    std::size_t at = 0;
+    std::size_t timeWidth = 4;
+    for (;;) {
+        const std::size_t isutcnt = static_cast<std::size_t>(readBE(data, at + 20, 4));
+        const std::size_t isstdcnt = static_cast<std::size_t>(readBE(data, at + 24, 4));
+        const std::size_t leapcnt = static_cast<std::size_t>(readBE(data, at + 28, 4));
+        const std::size_t timecnt = static_cast<std::size_t>(readBE(data, at + 32, 4));
+        const std::size_t typecnt = static_cast<std::size_t>(readBE(data, at + 36, 4));
+        const std::size_t charcnt = static_cast<std::size_t>(readBE(data, at + 40, 4));
+        const std::size_t body = at + 44;
+        const std::size_t blockEnd = body + (timecnt * timeWidth) + timecnt +
+                                     (typecnt * 6) + charcnt +
+                                     (leapcnt * (timeWidth + 4)) + isstdcnt + isutcnt;
+        if (version >= '2' && timeWidth == 4) {
+            at = blockEnd; // Skip the legacy 32-bit block
+            timeWidth = 8;
+            continue;
+        }
+        if (typecnt == 0 || blockEnd > data.size()) {
+            throw std::runtime_error("Corrupt TZif file: " + name);
+        }
+        const std::size_t idxAt = body + (timecnt * timeWidth);
+        const std::size_t typeAt = idxAt + timecnt;
+        auto typeOffset = [&](const std::size_t type) {
+            if (type >= typecnt) {
+                throw std::runtime_error("Corrupt TZif file: " + name);
+            }
+            return static_cast<std::int32_t>(readBE(data, typeAt + (type * 6), 4));
+        };
+        // Type 0 applies before the first transition
+        utcStarts.push_back(beginningOfTime);
+        offsets.push_back(typeOffset(0));
+        for (std::size_t i = 0; i < timecnt; i++) {
+            utcStarts.push_back(readBE(data, body + (i * timeWidth), timeWidth));
+            offsets.push_back(
+                typeOffset(static_cast<unsigned char>(data[idxAt + i])));
+        }
+        if (timeWidth == 8 && blockEnd < data.size() && data[blockEnd] == '\n') {
+            const std::size_t close = data.find('\n', blockEnd + 1);
+            if (close != std::string::npos && close > blockEnd + 1) {
+                extendWithRule(data.substr(blockEnd + 1, close - blockEnd - 1));
+            }
+        }
+        return;
+    }
+}
+
+void TimeZone::extendWithRule(const std::string &rule) {
+    const PosixRule posix(rule);
+    const std::int64_t last = utcStarts.back();
+    if (!posix.hasDst) {
+        if (last == beginningOfTime) {
+            offsets.back() = posix.stdOffset;
+        } else if (offsets.back() != posix.stdOffset) {
+            utcStarts.push_back(last + 1);
+            offsets.push_back(posix.stdOffset);
+        }
+        return;
+    }
+    std::vector<std::pair<std::int64_t, std::int32_t>> future;
+    const std::int64_t fromYear = last == beginningOfTime ? 1970 : yearOf(last);
+    for (std::int64_t y = fromYear; y <= lastRuleYear; y++) {
+        const auto [dstStart, dstEnd] = posix.transitions(y);
+        future.emplace_back(dstStart, posix.dstOffset);
+        future.emplace_back(dstEnd, posix.stdOffset);
+    }
+    std::sort(future.begin(), future.end());
+    for (const auto &[when, offset] : future) {
+        if (when > utcStarts.back()) {
+            utcStarts.push_back(when);
+            offsets.push_back(offset);
+        }
+    }
+}
+
+std::int64_t TimeZone::toUTC(const std::int64_t local, std::size_t &hint) const {
+    const std::size_t n = localStarts.size();
+    if (hint >= n || local < localStarts[hint] ||
+        (hint + 1 < n && local >= localStarts[hint + 1])) {
+        const auto it = std::upper_bound(localStarts.begin(), localStarts.end(), local);
+        hint = static_cast<std::size_t>(it - localStarts.begin()) - 1;
+    }
+    return local - offsets[hint];
+}
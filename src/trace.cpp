@@ -0,0 +1,93 @@
+#include "trace.hpp"
+
+#ifdef MIGRATE_TRACE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t ringSize = 1 << 16;
+constexpr std::uint64_t minSpanNanos = 10000;
+
+struct Event {
+    const char *name;
+    std::uint64_t start;
+    std::uint64_t end;
+};
+
+// Written only by its own thread; head is published so a dump sees whole events
+struct Ring {
+    std::size_t tid = 0;
+    std::atomic<std::uint64_t> head{0};
+    std::array<Event, ringSize> events;
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<Ring>> rings;
+
+// Rings are owned by the registry so they outlive the threads that filled them
+Ring *threadRing() {
+    thread_local Ring *ring = []() {
+        const std::lock_guard<std::mutex> lock(registryMutex);
+        rings.push_back(std::make_unique<Ring>());
+        rings.back()->tid = rings.size();
+        return rings.back().get();
+    }();
+    return ring;
+}
+
+} // namespace
+
+void traceRecord(const char *name, const std::uint64_t start, const std::uint64_t end) {
+    if (end - start < minSpanNanos) {
+        return;
+    }
+    Ring *ring = threadRing();
+    const std::uint64_t h = ring->head.load(std::memory_order_relaxed);
+    ring->events[h % ringSize] = {name, start, end};
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+void writeTrace(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot open trace file: " + path);
+    }
+    const std::lock_guard<std::mutex> lock(registryMutex);
+    std::uint64_t origin = std::numeric_limits<std::uint64_t>::max();
+    for (const auto &ring : rings) {
+        const std::uint64_t h = ring->head.load(std::memory_order_acquire);
+        for (std::uint64_t i = h > ringSize ? h - ringSize : 0; i < h; i++) {
+            origin = std::min(origin, ring->events[i % ringSize].start);
+        }
+    }
+    out << std::fixed << std::setprecision(3); // Microseconds, to the nanosecond
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto &ring : rings) {
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            << "\"tid\":" << ring->tid << ",\"args\":{\"name\":\"thread " << ring->tid
+            << "\"}}";
+        first = false;
+        const std::uint64_t h = ring->head.load(std::memory_order_acquire);
+        for (std::uint64_t i = h > ringSize ? h - ringSize : 0; i < h; i++) {
+            const Event &e = ring->events[i % ringSize];
+            // Span names are literals, so they need no JSON escaping
+            out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << ring->tid << ",\"ts\":" << static_cast<double>(e.start - origin) / 1000
+                << ",\"dur\":" << static_cast<double>(e.end - e.start) / 1000 << "}";
+        }
+    }
+    out << "\n]}\n";
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include "tune.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+static constexpr std::size_t minBuffer = 64 << 10;
+static constexpr std::size_t maxBuffer = 8 << 20;
+// A flush should carry about this much COPY time, long enough to amortise the call
+static constexpr double flushSecs = 0.002;
+// Extra workers must buy at least this much of the predicted time to be worth running
+static constexpr double threadGain = 0.05;
+
+// One worker fetches, encodes and sends in turn, so the stages add up per row
+static double tableSecs(const TableProfile &p) {
+    if (p.sampled == 0) {
+        return 0;
+    }
+    const double perRow = (p.fetchSecs + p.encodeSecs + p.copySecs) /
+                          static_cast<double>(p.sampled);
+    return perRow * static_cast<double>(std::max<std::uint64_t>(p.rows, p.sampled));
+}
+
+static std::size_t tableBuffer(const TableProfile &p) {
+    if (p.sampled == 0 || p.copySecs <= 0) {
+        return minBuffer;
+    }
+    const double target = static_cast<double>(p.bytes) / p.copySecs * flushSecs;
+    std::size_t size = minBuffer;
+    while (size < maxBuffer && static_cast<double>(size) < target) {
+        size <<= 1;
+    }
+    return size;
+}
+
+// Workers take tables in config order as they free up, exactly like the real run
+static double makespan(const std::vector<double> &secs, const std::uint32_t threads) {
+    std::vector<double> busy(threads, 0);
+    for (const double s : secs) {
+        *std::min_element(busy.begin(), busy.end()) += s;
+    }
+    return *std::max_element(busy.begin(), busy.end());
+}
+
+/**
+ * Pick the fewest workers whose predicted makespan is within threadGain of the best
+ * that any count up to maxThreads achieves, and the largest per-table send buffer,
+ * since small tables end with a partial flush anyway. The model assumes the source and
+ * destination keep up with every worker at its single-stream rate, so it is an upper
+ * bound on what extra threads buy.
+ */
+TunePlan planRun(const std::vector<TableProfile> &profiles,
+                 const std::uint32_t maxThreads) {
+    TunePlan plan;
+    for (const TableProfile &p : profiles) {
+        plan.tableSecs.push_back(tableSecs(p));
+        plan.tableBuffers.push_back(tableBuffer(p));
+    }
+    const auto tables = static_cast<std::uint32_t>(profiles.size());
+    const std::uint32_t most =
+        std::max<std::uint32_t>(1, std::min<std::uint32_t>(maxThreads, tables));
+    const double best = makespan(plan.tableSecs, most);
+    plan.threads = most;
+    for (std::uint32_t t = 1; t < most; t++) {
+        if (makespan(plan.tableSecs, t) <= best * (1 + threadGain)) {
+            plan.threads = t;
+            break;
+        }
+    }
+    plan.predictedSecs = makespan(plan.tableSecs, plan.threads);
+    plan.sendBufferSize = minBuffer;
+    for (const std::size_t b : plan.tableBuffers) {
+        plan.sendBufferSize = std::max(plan.sendBufferSize, b);
+    }
+    return plan;
+}
+
+void printPlan(const std::vector<TableProfile> &profiles, const TunePlan &plan) {
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1);
+    for (std::size_t i = 0; i < profiles.size(); i++) {
+        const TableProfile &p = profiles[i];
+        report << p.table << ": ~" << p.rows << " rows, sampled " << p.sampled;
+        if (p.sampled == 0) {
+            report << "\n";
+            continue;
+        }
+        const double n = static_cast<double>(p.sampled);
+        const char *bound = p.fetchSecs >= p.encodeSecs && p.fetchSecs >= p.copySecs
+                                ? "source"
+                            : p.encodeSecs >= p.copySecs ? "encode"
+                                                         : "destination";
+        report << "\n  " << static_cast<double>(p.bytes) / n << " bytes/row, fetch "
+               << p.fetchSecs / n * 1e6 << " us/row, encode " << p.encodeSecs / n * 1e6
+               << " us/row, copy " << p.copySecs / n * 1e6 << " us/row (" << bound
+               << " bound)\n  predicted " << plan.tableSecs[i] << " s, send buffer "
+               << (plan.tableBuffers[i] >> 10) << " KiB\n";
+    }
+    report << "Predicted total: " << plan.predictedSecs << " s with " << plan.threads
+           << " workers\nReuse with: --threads " << plan.threads << " --send-buffer-kb "
+           << (plan.sendBufferSize >> 10) << "\n";
+    std::cout << report.str() << std::flush;
+}
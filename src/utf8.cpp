@@ -0,0 +1,296 @@
+#include "utf8.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+Charset parseCharset(const std::string &name) {
+    std::string n = name;
+    std::transform(n.begin(), n.end(), n.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (n == "utf8" || n == "utf8mb3" || n == "utf8mb4" || n == "utf-8") {
+        return Charset::UTF8;
+    }
+    if (n == "latin1" || n == "cp1252" || n == "windows-1252") {
+        return Charset::CP1252;
+    }
+    if (n == "iso-8859-1" || n == "iso8859-1") {
+        return Charset::LATIN1;
+    }
+    throw std::runtime_error("Unknown charset: " + name);
+}
+
+/**
+ * Length of the well-formed sequence at p, or 0 when it is invalid, truncated or NUL.
+ * Second-byte ranges rule out overlongs (E0, F0), surrogates (ED) and values past
+ * U+10FFFF (F4), following the Unicode table of well-formed byte sequences.
+ */
+static std::size_t sequenceLength(const unsigned char *p, const std::size_t n) {
+    const unsigned c = p[0];
+    if (c < 0x80) {
+        return c != 0 ? 1 : 0;
+    }
+    std::size_t len;
+    unsigned lo = 0x80;
+    unsigned hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        lo = c == 0xE0 ? 0xA0 : lo;
+        hi = c == 0xED ? 0x9F : hi;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        lo = c == 0xF0 ? 0x90 : lo;
+        hi = c == 0xF4 ? 0x8F : hi;
+    } else {
+        return 0;
+    }
+    if (n < len || p[1] < lo || p[1] > hi) {
+        return 0;
+    }
+    for (std::size_t k = 2; k < len; k++) {
+        if (p[k] < 0x80 || p[k] > 0xBF) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+// Offset of the first byte that does not start a well-formed sequence, or n
+static std::size_t firstInvalid(const char *data, const std::size_t n) {
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    std::size_t i = 0;
+    while (i < n) {
+        const std::size_t len = sequenceLength(p + i, n - i);
+        if (len == 0) {
+            return i;
+        }
+        i += len;
+    }
+    return n;
+}
+
+// Length of the leading run of 7-bit, non-NUL bytes
+static std::size_t asciiPrefix(const char *p, const std::size_t n) {
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        // The sign bit marks bytes >= 0x80
+        const auto mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero))));
+        if (mask != 0) {
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+    }
+#endif
+    while (i < n && static_cast<unsigned char>(p[i]) - 1u < 0x7Fu) {
+        i++;
+    }
+    return i;
+}
+
+#if defined(__SSSE3__)
+/**
+ * Keiser and Lemire's lookup validator ("Validating UTF-8 in less than one instruction
+ * per byte"). Each byte is classified by three 16-entry tables indexed by the high and
+ * low nibble of the previous byte and the high nibble of the current one; ANDing them
+ * leaves a bit set only for a malformed two-byte pair. Third and fourth bytes are
+ * checked by comparing where continuations must appear with where they do.
+ */
+static constexpr std::uint8_t tooShort = 1 << 0;
+static constexpr std::uint8_t tooLong = 1 << 1;
+static constexpr std::uint8_t overlong3 = 1 << 2;
+static constexpr std::uint8_t tooLarge = 1 << 3;
+static constexpr std::uint8_t surrogate = 1 << 4;
+static constexpr std::uint8_t overlong2 = 1 << 5;
+static constexpr std::uint8_t tooLarge1000 = 1 << 6;
+static constexpr std::uint8_t overlong4 = 1 << 6;
+static constexpr std::uint8_t twoConts = 1 << 7;
+static constexpr std::uint8_t carry = tooShort | tooLong | twoConts;
+
+alignas(16) static const std::uint8_t byte1High[16] = {
+    tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+    twoConts, twoConts, twoConts, twoConts,
+    tooShort | overlong2,
+    tooShort,
+    tooShort | overlong3 | surrogate,
+    tooShort | tooLarge | tooLarge1000 | overlong4,
+};
+
+alignas(16) static const std::uint8_t byte1Low[16] = {
+    carry | overlong3 | overlong2 | overlong4,
+    carry | overlong2,
+    carry,
+    carry,
+    carry | tooLarge,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000 | surrogate,
+    carry | tooLarge | tooLarge1000,
+    carry | tooLarge | tooLarge1000,
+};
+
+alignas(16) static const std::uint8_t byte2High[16] = {
+    tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+    tooLong | overlong2 | twoConts | overlong3 | tooLarge1000 | overlong4,
+    tooLong | overlong2 | twoConts | overlong3 | tooLarge,
+    tooLong | overlong2 | twoConts | surrogate | tooLarge,
+    tooLong | overlong2 | twoConts | surrogate | tooLarge,
+    tooShort, tooShort, tooShort, tooShort,
+};
+
+// Largest byte that may end a block without a continuation spilling into the next
+alignas(16) static const std::uint8_t maxTail[16] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+static __m128i load(const std::uint8_t *table) {
+    return _mm_load_si128(reinterpret_cast<const __m128i *>(table));
+}
+
+static __m128i highNibbles(const __m128i v) {
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+static __m128i blockErrors(const __m128i input, const __m128i prev) {
+    const __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    const __m128i lowNibbles = _mm_and_si128(prev1, _mm_set1_epi8(0x0F));
+    const __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(load(byte1High), highNibbles(prev1)),
+                      _mm_shuffle_epi8(load(byte1Low), lowNibbles)),
+        _mm_shuffle_epi8(load(byte2High), highNibbles(input)));
+    // Only 111xxxxx two bytes back or 1111xxxx three back stay >= 0x80
+    const __m128i third =
+        _mm_subs_epu8(_mm_alignr_epi8(input, prev, 14), _mm_set1_epi8(0x60));
+    const __m128i fourth =
+        _mm_subs_epu8(_mm_alignr_epi8(input, prev, 13), _mm_set1_epi8(0x70));
+    const __m128i mustContinue = _mm_and_si128(_mm_or_si128(third, fourth),
+                                               _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(mustContinue, special);
+}
+
+bool isValidUtf8(const char *data, const std::size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i errors = zero;
+    __m128i prev = zero;
+    __m128i incomplete = zero;
+    const auto step = [&](const __m128i input) {
+        errors = _mm_or_si128(errors, _mm_cmpeq_epi8(input, zero));
+        if (_mm_movemask_epi8(input) == 0) {
+            errors = _mm_or_si128(errors, incomplete);
+            incomplete = zero;
+        } else {
+            errors = _mm_or_si128(errors, blockErrors(input, prev));
+            incomplete = _mm_subs_epu8(input, load(maxTail));
+        }
+        prev = input;
+    };
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        step(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+    }
+    if (i < size) {
+        // Pad with spaces: ASCII, so they end any sequence, and not NUL
+        alignas(16) char tail[16];
+        std::memset(tail, ' ', sizeof(tail));
+        std::memcpy(tail, data + i, size - i);
+        step(_mm_load_si128(reinterpret_cast<const __m128i *>(tail)));
+    }
+    errors = _mm_or_si128(errors, incomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(errors, zero)) == 0xFFFF;
+}
+#else
+bool isValidUtf8(const char *data, const std::size_t size) {
+    std::size_t i = asciiPrefix(data, size);
+    return i == size || i + firstInvalid(data + i, size - i) == size;
+}
+#endif
+
+static void appendCodePoint(std::string &out, const unsigned cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Windows-1252 0x80-0x9F; the unassigned 81, 8D, 8F, 90 and 9D stay C1 controls
+static const std::uint16_t cp1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+};
+
+static const char *const replacement = "\xEF\xBF\xBD";
+
+[[noreturn]] static void rejectAt(const std::size_t offset, const bool nul) {
+    throw std::invalid_argument(std::string(nul ? "NUL byte" : "invalid UTF-8") +
+                                " at byte " + std::to_string(offset));
+}
+
+void toUtf8(std::string &value, const Charset from, const InvalidText policy,
+            std::string &scratch) {
+    const char *data = value.data();
+    const std::size_t n = value.size();
+    std::size_t i;
+    if (from == Charset::UTF8) {
+        if (isValidUtf8(data, n)) {
+            return;
+        }
+        i = firstInvalid(data, n);
+    } else {
+        i = asciiPrefix(data, n);
+        if (i == n) {
+            return;
+        }
+    }
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    scratch.assign(data, i);
+    while (i < n) {
+        const unsigned char c = p[i];
+        if (c == 0 || (from == Charset::UTF8 && sequenceLength(p + i, n - i) == 0)) {
+            if (policy == InvalidText::REJECT) {
+                rejectAt(i, c == 0);
+            }
+            if (policy == InvalidText::REPLACE) {
+                scratch += replacement;
+            }
+            i++;
+        } else if (c < 0x80) {
+            const std::size_t run = asciiPrefix(data + i, n - i);
+            scratch.append(data + i, run);
+            i += run;
+        } else if (from == Charset::UTF8) {
+            const std::size_t len = sequenceLength(p + i, n - i);
+            scratch.append(data + i, len);
+            i += len;
+        } else {
+            const bool windows = from == Charset::CP1252 && c < 0xA0;
+            appendCodePoint(scratch, windows ? cp1252High[c - 0x80] : c);
+            i++;
+        }
+    }
+    value.swap(scratch);
+}